@@ -0,0 +1,108 @@
+#include "acpi.h"
+#include "../drivers/console.h"
+#include "../lib/string.h"
+#include "../mm/pmm.h"
+
+extern pg_table_t* kernel_pml4;
+
+static acpi_sdt_header_t* root_table = NULL; // RSDT 或 XSDT
+static bool root_is_xsdt = false;
+
+/**
+ * @brief 确保 [pa, pa+len) 在 HHDM 中有映射（固件保留区不在 paging_init 的映射范围内）
+ * 
+ * @param pa 
+ * @param len 
+ * @return void* 对应的 HHDM 虚拟地址
+ */
+static void* acpi_map(uint64_t pa, size_t len) {
+    for(uint64_t page = ALIGN_DOWN(pa, PAGE_SIZE); page < pa + len; page += PAGE_SIZE) {
+        pte_t* pte = vmm_get_leaf(kernel_pml4, page + HHDM_OFFSET, NULL);
+        if(pte == NULL || !(*pte & PTE_PRESENT)) {
+            vmm_map_page(kernel_pml4, page + HHDM_OFFSET, page, PTE_KERNEL);
+        }
+    }
+    return (void*)(pa + HHDM_OFFSET);
+}
+
+/**
+ * @brief 字节和为 0 则校验通过
+ * 
+ * @param p 
+ * @param len 
+ * @return true 
+ * @return false 
+ */
+static bool acpi_checksum(const void* p, size_t len) {
+    uint8_t sum = 0;
+    for(size_t i = 0; i < len; i++) sum += ((const uint8_t*)p)[i];
+    return sum == 0;
+}
+
+/**
+ * @brief 映射一张表：先映射表头拿到长度，再映射整张表并校验
+ * 
+ * @param pa 
+ * @return acpi_sdt_header_t* 
+ */
+static acpi_sdt_header_t* acpi_map_table(uint64_t pa) {
+    acpi_sdt_header_t* hdr = acpi_map(pa, sizeof(acpi_sdt_header_t));
+    acpi_map(pa, hdr->length);
+    if(!acpi_checksum(hdr, hdr->length)) return NULL;
+    return hdr;
+}
+
+void acpi_init(uint64_t rsdp_pa) {
+    if(rsdp_pa == 0) {
+        kprintln("ACPI: no RSDP provided by bootloader");
+        return;
+    }
+    // 早期的 Limine 修订版给的是 HHDM 虚拟地址
+    if(rsdp_pa >= HHDM_OFFSET) rsdp_pa -= HHDM_OFFSET;
+
+    acpi_rsdp_t* rsdp = acpi_map(rsdp_pa, sizeof(acpi_rsdp_t));
+    if(memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || !acpi_checksum(rsdp, 20)) {
+        kprintln("ACPI: invalid RSDP");
+        return;
+    }
+
+    if(rsdp->revision >= 2 && rsdp->xsdt_address) {
+        root_table = acpi_map_table(rsdp->xsdt_address);
+        root_is_xsdt = true;
+    } else {
+        root_table = acpi_map_table(rsdp->rsdt_address);
+        root_is_xsdt = false;
+    }
+    if(root_table == NULL) {
+        kprintln("ACPI: root table checksum mismatch");
+        return;
+    }
+    kprintf("ACPI: revision %d, %s at %lx\n", rsdp->revision,
+        root_is_xsdt ? "XSDT" : "RSDT", (uint64_t)root_table - HHDM_OFFSET);
+}
+
+acpi_sdt_header_t* acpi_find_table(const char* signature) {
+    if(root_table == NULL) return NULL;
+
+    size_t entry_size = root_is_xsdt ? 8 : 4;
+    size_t count = (root_table->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t* entries = (uint8_t*)root_table + sizeof(acpi_sdt_header_t);
+    for(size_t i = 0; i < count; i++) {
+        uint64_t pa;
+        if(root_is_xsdt) {
+            memcpy(&pa, entries + i * 8, 8);
+        } else {
+            uint32_t pa32;
+            memcpy(&pa32, entries + i * 4, 4);
+            pa = pa32;
+        }
+        acpi_sdt_header_t* hdr = acpi_map(pa, sizeof(acpi_sdt_header_t));
+        if(memcmp(hdr->signature, signature, 4) != 0) continue;
+        return acpi_map_table(pa);
+    }
+    return NULL;
+}
+
+void acpi_release(void) {
+    root_table = NULL;
+}
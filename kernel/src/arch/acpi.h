@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// RSDP (Root System Description Pointer)
+typedef struct {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;       // 前 20 字节校验和
+    char oem_id[6];
+    uint8_t revision;       // 0 = ACPI 1.0（只有 RSDT），2 = ACPI 2.0+（有 XSDT）
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+// 所有系统描述表共用的表头
+typedef struct {
+    char signature[4];
+    uint32_t length;        // 整张表的长度（含表头）
+    uint8_t revision;
+    uint8_t checksum;       // 整张表字节和为 0
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+/**
+ * @brief 通过 RSDP 定位 RSDT / XSDT，之后才能 acpi_find_table
+ *        ACPI 表所在的页按需映射进 HHDM，必须在 paging_init 之后调用
+ * 
+ * @param rsdp_pa RSDP 的物理地址，0 表示固件没有提供
+ */
+void acpi_init(uint64_t rsdp_pa);
+
+/**
+ * @brief 按签名查找 ACPI 表
+ * 
+ * @param signature 4 字节签名，如 "SRAT"
+ * @return acpi_sdt_header_t* 表的虚拟地址（HHDM），找不到或校验失败返回 NULL
+ */
+acpi_sdt_header_t* acpi_find_table(const char* signature);
+
+/**
+ * @brief 丢弃 RSDT / XSDT 指针，之后 acpi_find_table 一律返回 NULL
+ *        ACPI 表位于 ACPI 可回收内存，必须在 pmm_reclaim_boot_memory 之前调用
+ * 
+ */
+void acpi_release(void);
@@ -92,6 +92,7 @@ void idt_init() {
     // 0x8E = 1(Present) 00(Ring0) 0(S) 1110(Interrupt Gate)
     idt_set_gate(0, (uint64_t)isr0, 0x08, 0x8E); // 内核代码段是0x28(limine默认是这个)
     idt_set_gate(14, (uint64_t)isr14, 0x08, 0x8E);
+    register_interrupt_handler(14, page_fault_handler);
 
     // 3. 设置硬件中断 (32-47)
     idt_set_gate(32, (uint64_t)isr32, 0x08, 0x8E); // 时钟
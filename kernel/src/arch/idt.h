@@ -15,3 +15,6 @@ typedef void (*isr_t)(registers_t*);
 // 初始化函数原型
 void idt_init();
 void register_interrupt_handler(uint8_t n, isr_t handler);
+
+// 缺页异常处理，idt_init 中注册到 14 号向量
+void page_fault_handler(registers_t* regs);
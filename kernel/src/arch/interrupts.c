@@ -4,6 +4,8 @@
 #include "../proc/proc.h"
 #include "../proc/sche.h"
 #include "../fs/ramfs.h"
+#include "../mm/vmalloc.h"
+#include "../mm/kmprof.h"
 
 isr_t interrupt_handlers[256];
 
@@ -32,7 +34,7 @@ int do_execve(const char *path, const char *argv[], const char *envp[])
     ramfs_fstat(fd, &st);
 
     // 3. 读取 ELF 文件头和内容
-    char *elf_buf = (char *)kmalloc(st.size);
+    char *elf_buf = (char *)vmalloc(st.size);
     if (!elf_buf)
     {
         ramfs_close(fd);
@@ -44,18 +46,36 @@ int do_execve(const char *path, const char *argv[], const char *envp[])
 
     if (read_bytes != st.size)
     {
-        kfree(elf_buf);
+        vfree(elf_buf);
         return -1;
     }
 
-    // 4. 加载 ELF (proc.c 中定义)
-    uint64_t entry_point = load_elf(current_proc, elf_buf);
-    kfree(elf_buf);
+    // 4. 丢弃旧映像之后就不能再返回原程序了，先确认是 ELF 文件
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)elf_buf;
+    if (read_bytes < (int)sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, "\x7F" "ELF", 4) != 0)
+    {
+        vfree(elf_buf);
+        return -1;
+    }
+
+    // 5. 加载 ELF (proc.c 中定义)：新映像装进一个只有用户栈的地址空间
+    uint64_t entry_point = 0;
+    if (exec_mm_reset(current_proc))
+        entry_point = load_elf(current_proc, elf_buf);
+    vfree(elf_buf);
 
     if (entry_point == 0)
-        return -1;
+    {
+        // 旧映像已经没了（path 指向的用户内存也一样），只能结束进程
+        kprintf("Process %d: execve failed after dropping the old image\n", current_proc->pid);
+        current_proc->exit_code = 128 + 11;
+        current_proc->proc_state = PROC_ZOMBIE;
+        schedule(); // 切换进程，不再返回
+        while (1)
+            ;
+    }
 
-    // 5. 修改中断现场 (Trap Frame)
+    // 6. 修改中断现场 (Trap Frame)
     // 当 syscall_handler 返回执行 iretq 时，CPU 会从栈上弹出 RIP/RSP
     // 我们修改栈上的值，让它"返回"到新程序的入口，而不是原来的地方
     if (current_proc->trap_frame)
@@ -219,56 +239,32 @@ void syscall_handler(registers_t *regs)
         break;
 
     // ============================
-    // 3. 内存管理 (9, 11, 12)
+    // 3. 内存管理 (9, 10, 11, 12, 28)
     // ============================
     case 9: // SYS_MMAP (addr, len, prot, flags, fd, offset)
-    {
-        // 极简实现：只支持匿名映射 (MAP_ANONYMOUS)，忽略 fd
-        uint64_t len = arg2;
-        uint64_t flags = regs->r10; // 第4个参数
-
-        // 如果 addr 为 0，应该找一块空闲区域。
-        // 这里为了最简单，我们直接让它失败，强制用户使用 malloc (通过 brk)
-        // 或者：直接在堆顶上方映射一块 (非常危险，但能跑)
-        ret = 0; // 0 表示失败
+        // 匿名映射或 ramfs 文件映射，失败返回 MAP_FAILED
+        if (regs->r10 & MAP_ANONYMOUS)
+            ret = mm_mmap(current_proc->mm, arg1, arg2, (int)arg3, (int)regs->r10, NULL, 0);
+        else
+            ret = ramfs_mmap((int)regs->r8, arg1, arg2, (int)arg3, (int)regs->r10, regs->r9);
+        break;
+
+    case 10: // SYS_MPROTECT (addr, len, prot)
+        ret = mm_mprotect(current_proc->mm, arg1, arg2, (int)arg3);
         break;
-    }
 
     case 11: // SYS_MUNMAP (addr, len)
-        // 暂不回收内存，直接返回成功
-        ret = 0;
+        ret = mm_munmap(current_proc->mm, arg1, arg2);
         break;
 
-    case 12: // SYS_BRK (addr)
-    {
-        uint64_t new_brk = arg1;
-        uint64_t cur_brk = current_proc->mm->heap;
+    case 28: // SYS_MADVISE (addr, len, advice)
+        ret = mm_madvise(current_proc->mm, arg1, arg2, (int)arg3);
+        break;
 
-        if (new_brk == 0)
-        {
-            ret = cur_brk; // 返回当前堆位置
-        }
-        else if (new_brk > cur_brk)
-        {
-            // 扩展堆：映射内存
-            uint64_t size = new_brk - cur_brk;
-            // 注意：需要确保 vmm.h 中有 VM_HEAP 等定义
-            if (mm_map_range(current_proc->mm, cur_brk, size, VM_READ | VM_WRITE | VM_HEAP))
-            {
-                current_proc->mm->heap = new_brk;
-                ret = new_brk;
-            }
-            else
-            {
-                ret = cur_brk; // 失败返回旧值
-            }
-        }
-        else
-        {
-            ret = cur_brk; // 不支持收缩
-        }
+    case 12: // SYS_BRK (addr)
+        // addr 为 0 时返回当前堆顶；扩展只延长堆 VMA，收缩释放多出来的页；失败返回旧值
+        ret = mm_brk(current_proc->mm, arg1);
         break;
-    }
 
     // ============================
     // 4. 进程管理 (24, 39, 57, 59, 60, 61, 110)
@@ -326,6 +322,17 @@ void syscall_handler(registers_t *regs)
         ret = 0;
         break;
 
+    // ============================
+    // 6. SudoOS 调试 (500)
+    // ============================
+    case 500: // SYS_KMPROF (cmd)
+        ret = kmprof_ctl((int)arg1);
+        break;
+
+    case 501: // SYS_THP (cmd)
+        ret = thp_ctl((int)arg1);
+        break;
+
     default:
         kprintf("Warning: Unknown Syscall %d\n", syscall_num);
         ret = -1;
@@ -336,6 +343,42 @@ void syscall_handler(registers_t *regs)
     regs->rax = ret;
 }
 
+void page_fault_handler(registers_t *regs)
+{
+    uint64_t addr = rcr2();
+    mm_struct_t *mm = current_proc ? current_proc->mm : NULL;
+
+    // 用户地址（包括内核在系统调用中访问用户缓冲区）按 VMA 补页
+    if (mm && addr < USER_SPACE_END && mm_handle_fault(mm, addr, regs->err_code))
+    {
+        current_proc->min_flt++;
+        return;
+    }
+
+    // 内核态的缺页补不上就是 bug：内核地址本不该缺页，系统调用里访问用户地址也只有按 VMA 补页这一条合法路径，
+    // 没有异常修复表可以让系统调用返回错误，和其他异常一样停机
+    if (mm == NULL || !(regs->err_code & PF_USER))
+    {
+        kprintf("=== CPU EXCEPTION ===\n");
+        kprintf("Exception: 14: Page Fault\n");
+        kprintf("Address: %lx\n", addr);
+        kprintf("Error Code: %lx\n", regs->err_code);
+        kprintf("RIP: %lx\n", regs->rip);
+        kprintf("=====================\n");
+        while (1)
+            hlt();
+    }
+
+    // 用户态的非法访问：杀死进程，退出码与 shell 中被 SIGSEGV 杀死的进程一致
+    kprintf("Process %d: segmentation fault at %lx (rip %lx, error %lx)\n",
+            current_proc->pid, addr, regs->rip, regs->err_code);
+    current_proc->exit_code = 128 + 11;
+    current_proc->proc_state = PROC_ZOMBIE;
+    schedule(); // 切换进程，不再返回
+    while (1)
+        ;
+}
+
 static const char *exception_messages[] = {
     "0: Divide-by-zero Error",
     "1: Debug Exception",
@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 // 告诉编译器，不要把这行代码前面的内存访问指令优化（重排）到这行代码后面。
 #define barrier() __asm__ __volatile__ ("" ::: "memory")
@@ -49,8 +50,21 @@ static inline void lcr3(uintptr_t cr3) __attribute__((always_inline));
 static inline uintptr_t rcr0(void) __attribute__((always_inline));
 static inline uintptr_t rcr2(void) __attribute__((always_inline));
 static inline uintptr_t rcr3(void) __attribute__((always_inline));
+static inline void lcr4(uintptr_t cr4) __attribute__((always_inline));
+static inline uintptr_t rcr4(void) __attribute__((always_inline));
 
 static inline void invlpg(void *addr) __attribute__((always_inline));
+static inline void tlb_flush_all(void) __attribute__((always_inline));
+
+// CR0.WP：置位后内核写只读页也会触发缺页
+#define CR0_WP (1ull << 16)
+// CR4.PGE：开启后带 PTE_GLOBAL 的映射在加载 CR3 时不被刷出 TLB
+#define CR4_PGE (1ull << 7)
+// CR4.PCIDE：开启后 CR3[11:0] 是 PCID，TLB 项按 PCID 区分
+#define CR4_PCIDE (1ull << 17)
+// 写 CR3 时置位则不刷新新 PCID 的 TLB 项（该位不会被存入 CR3）
+#define CR3_NOFLUSH (1ull << 63)
+#define CR3_PCID_MASK 0xFFFull
 
 /* 字符串操作优化 */
 static inline int __strcmp(const char *s1, const char *s2) __attribute__((always_inline));
@@ -307,6 +321,26 @@ static inline uintptr_t rcr3(void) {
     return cr3;
 }
 
+/**
+ * @brief 加载 CR4。
+ * 
+ * @param cr4 
+ */
+static inline void lcr4(uintptr_t cr4) {
+    asm volatile ("mov %0, %%cr4" :: "r" (cr4) : "memory");
+}
+
+/**
+ * @brief 读取 CR4。
+ * 
+ * @return uintptr_t 
+ */
+static inline uintptr_t rcr4(void) {
+    uintptr_t cr4;
+    asm volatile ("mov %%cr4, %0" : "=r" (cr4) :: "memory");
+    return cr4;
+}
+
 /**
  * @brief 刷新 TLB (Translation Lookaside Buffer)。
  * 
@@ -316,6 +350,22 @@ static inline void invlpg(void *addr) {
     asm volatile ("invlpg (%0)" :: "r" (addr) : "memory");
 }
 
+/**
+ * @brief 刷新整个 TLB，包括全局页。加载 CR3 不会刷掉全局页，
+ *        内核映射大范围变化时（invlpg 逐页失效不划算）用这个
+ * 
+ */
+static inline void tlb_flush_all(void) {
+    uintptr_t cr4 = rcr4();
+    if (cr4 & CR4_PGE) {
+        // 翻转 PGE 会使所有 TLB 项失效
+        lcr4(cr4 & ~CR4_PGE);
+        lcr4(cr4);
+    } else {
+        lcr3(rcr3());
+    }
+}
+
 /* 字符串函数优化 */
 
 #ifndef __HAVE_ARCH_STRCMP
@@ -441,3 +491,87 @@ static inline void wrmsr(uint32_t msr, uint64_t value) {
     asm volatile("wrmsr" : : "c"(msr), "a"(low), "d"(high));
 }
 
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+/**
+ * @brief 当前 CPU 的初始 Local APIC ID（CPUID.01H:EBX[31:24]）
+ * 
+ * @return uint32_t 
+ */
+static inline uint32_t cpu_apic_id(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return ebx >> 24;
+}
+
+/**
+ * @brief CPU 是否支持 1GiB 页（CPUID.80000001H:EDX[26]）
+ * 
+ * @return true 
+ * @return false 
+ */
+static inline bool cpu_has_pdpe1gb(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000001) return false;
+    cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    return (edx >> 26) & 1;
+}
+
+/**
+ * @brief CPU 是否支持 PCID（CPUID.01H:ECX[17]）
+ * 
+ * @return true 
+ * @return false 
+ */
+static inline bool cpu_has_pcid(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (ecx >> 17) & 1;
+}
+
+/**
+ * @brief 读取时间戳计数器
+ * 
+ * @return uint64_t 
+ */
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 保存 RFLAGS 并关中断，返回值交给 irq_restore 恢复
+ * 
+ * @return uint64_t 
+ */
+static inline uint64_t irq_save(void) {
+    uint64_t rflags = read_rflags();
+    cli();
+    return rflags;
+}
+
+/**
+ * @brief 若 irq_save 之前是开中断的，则重新开中断
+ * 
+ * @param rflags 
+ */
+static inline void irq_restore(uint64_t rflags) {
+    if (rflags & (1 << 9)) sti();
+}
+
+// 最多支持的 CPU 数（per-CPU 数据按此大小静态分配）
+#define NR_CPUS 8
+
+/**
+ * @brief 当前 CPU 编号。目前只启动了 BSP，恒为 0
+ * 
+ * @return int 
+ */
+static inline int cpu_id(void) {
+    return 0;
+}
@@ -17,6 +17,8 @@
 
 static char history_buffer[MAX_HISTORY][MAX_COLS];
 static struct limine_framebuffer* g_fb = NULL;
+// framebuffer 描述的副本：Limine 的响应位于可回收内存，启动后会被 PMM 回收
+static struct limine_framebuffer g_fb_info;
 
 // 逻辑坐标 (在 buffer 中的位置)
 static int g_cursor_x = 0;
@@ -111,7 +113,12 @@ void console_refresh() {
 // === 公开接口 ===
 
 void console_init(struct limine_framebuffer* fb) {
-    g_fb = fb;
+    g_fb_info = *fb;
+    g_fb_info.edid = NULL;
+    g_fb_info.edid_size = 0;
+    g_fb_info.modes = NULL;
+    g_fb_info.mode_count = 0;
+    g_fb = &g_fb_info;
     
     // 计算屏幕容量
     g_screen_cols = g_fb->width / (FONT_W * SCALE);
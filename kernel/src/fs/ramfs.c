@@ -2,6 +2,7 @@
 #include "../proc/proc.h"
 #include "../mm/pmm.h"
 #include "../drivers/console.h"
+#include "../mm/slab.h"
 
 #define MAX_FILES 64
 #define MAX_SYSTEM_OPEN_FILES 128 // 系统允许同时打开的最大文件句柄数
@@ -12,8 +13,9 @@
 // RAMFS 节点存储
 static ramfs_node_t files[MAX_FILES];
 
-// 全局静态文件句柄表
-static file_t global_file_table[MAX_SYSTEM_OPEN_FILES];
+// 文件句柄对象缓存
+static kmem_cache_t* file_cache = NULL;
+static int nr_open_files = 0;
 
 // Linux dirent64 结构
 struct linux_dirent64 {
@@ -37,14 +39,13 @@ static file_t** get_cur_fd_table() {
 
 // 辅助：分配一个全局文件句柄
 static file_t* alloc_file_handle() {
-    for (int i = 0; i < MAX_SYSTEM_OPEN_FILES; i++) {
-        if (global_file_table[i].ref_count == 0) {
-            memset(&global_file_table[i], 0, sizeof(file_t));
-            global_file_table[i].ref_count = 1; // 标记为已使用
-            return &global_file_table[i];
-        }
-    }
-    return NULL;
+    if (nr_open_files >= MAX_SYSTEM_OPEN_FILES) return NULL;
+    file_t* f = kmem_cache_alloc(file_cache);
+    if (!f) return NULL;
+    memset(f, 0, sizeof(file_t));
+    f->ref_count = 1; // 标记为已使用
+    nr_open_files++;
+    return f;
 }
 
 // 辅助：释放文件句柄
@@ -52,6 +53,8 @@ static void free_file_handle(file_t* f) {
     if (f) {
         f->ref_count = 0;
         f->node = NULL;
+        kmem_cache_free(file_cache, f);
+        nr_open_files--;
     }
 }
 
@@ -121,9 +124,20 @@ static int resolve_path(const char* path, int* parent_out, char* name_out) {
     return curr;
 }
 
+/**
+ * @brief 分配一页已清零的文件内容缓冲区
+ * 
+ * @return uint8_t* 失败返回 NULL
+ */
+static uint8_t* ramfs_alloc_buffer() {
+    uint64_t pa = pmm_alloc_zeroed_page();
+    if(pa == 0) return NULL;
+    return (uint8_t*)(pa + HHDM_OFFSET);
+}
+
 void ramfs_init(void* init_addr, uint64_t init_size) {
     memset(files, 0, sizeof(files));
-    memset(global_file_table, 0, sizeof(global_file_table)); 
+    if (!file_cache) file_cache = kmem_cache_create("file_t", sizeof(file_t), 0, NULL);
     
     // 1. 创建根目录 "/"
     files[0].is_used = true;
@@ -168,7 +182,7 @@ void ramfs_init(void* init_addr, uint64_t init_size) {
     files[shell_idx].type = RAMFS_TYPE_FILE;
     files[shell_idx].parent_idx = usr_idx;
     char* shell_code = "// This is SudoOS Shell Source Code...\n";
-    files[shell_idx].content = (uint8_t*)kmalloc(PAGE_SIZE);
+    files[shell_idx].content = ramfs_alloc_buffer();
     strcpy((char*)files[shell_idx].content, shell_code);
     files[shell_idx].size = strlen(shell_code);
 
@@ -178,7 +192,7 @@ void ramfs_init(void* init_addr, uint64_t init_size) {
     files[main_idx].type = RAMFS_TYPE_FILE;
     files[main_idx].parent_idx = usr_idx;
     char* main_code = "// User Main Entry Point\n";
-    files[main_idx].content = (uint8_t*)kmalloc(PAGE_SIZE);
+    files[main_idx].content = ramfs_alloc_buffer();
     
     // 【修正】下标使用 main_idx，而不是 main_code
     strcpy((char*)files[main_idx].content, main_code); 
@@ -200,8 +214,7 @@ int ramfs_open(const char* path, int flags) {
         files[inode].type = RAMFS_TYPE_FILE;
         files[inode].parent_idx = parent_idx;
         files[inode].size = 0;
-        files[inode].content = (uint8_t*)kmalloc(4096);
-        memset(files[inode].content, 0, 4096);
+        files[inode].content = ramfs_alloc_buffer();
     } else if (inode == -1) {
         return -1;
     }
@@ -391,4 +404,21 @@ int ramfs_fstat(int fd, void* buf) {
     file_t** fds = get_cur_fd_table();
     if (fd < 0 || fd >= MAX_FD || fds[fd] == NULL) return -1;
     return ramfs_stat(fds[fd]->node->name, buf);
-}
\ No newline at end of file
+}
+
+uint64_t ramfs_get_page(ramfs_node_t* node, uint64_t pgoff) {
+    if (pgoff >= ALIGN_UP(node->size, PAGE_SIZE) / PAGE_SIZE) return 0;
+    uint64_t pa = (uint64_t)node->content - HHDM_OFFSET + pgoff * PAGE_SIZE;
+    if (pa2pgidx(pa) >= total_pages) return 0;
+    return pa;
+}
+
+uint64_t ramfs_mmap(int fd, uint64_t addr, uint64_t len, int prot, int flags, uint64_t offset) {
+    file_t** fds = get_cur_fd_table();
+    if (!fds || fd < 0 || fd >= MAX_FD || fds[fd] == NULL) return MAP_FAILED;
+    ramfs_node_t* node = fds[fd]->node;
+    if (node->type != RAMFS_TYPE_FILE || node->content == NULL) return MAP_FAILED;
+    // 内容（HHDM 中的物理连续内存）和偏移都页对齐，才能把文件页原样映射给进程
+    if (((uint64_t)node->content & (PAGE_SIZE - 1)) || (offset & (PAGE_SIZE - 1))) return MAP_FAILED;
+    return mm_mmap(current_proc->mm, addr, len, prot, flags, node, offset / PAGE_SIZE);
+}
@@ -7,7 +7,7 @@
 #define RAMFS_TYPE_DIR  2
 
 // 文件节点结构升级
-typedef struct {
+typedef struct ramfs_node {
     char name[32];      // 文件名 (不包含路径，例如 "bin")
     uint8_t* content;   // 文件内容指针
     uint64_t size;      // 文件大小
@@ -37,4 +37,19 @@ int ramfs_write(int fd, const void* buf, int count);
 void ramfs_close(int fd);
 int ramfs_getdents64(int fd, void* dirp, int count);
 int ramfs_stat(const char* path, void* buf);
-int ramfs_fstat(int fd, void* buf);
\ No newline at end of file
+int ramfs_fstat(int fd, void* buf);
+
+/**
+ * @brief 文件第 pgoff 页内容所在的物理页，mmap 直接映射它
+ * 
+ * @return uint64_t 超出文件末尾返回 0
+ */
+uint64_t ramfs_get_page(ramfs_node_t* node, uint64_t pgoff);
+
+/**
+ * @brief SYS_MMAP 的文件映射：检查 fd 和 offset 后交给 mm_mmap
+ * 
+ * @param offset 文件内偏移，必须页对齐
+ * @return uint64_t 映射的起始地址，失败返回 MAP_FAILED
+ */
+uint64_t ramfs_mmap(int fd, uint64_t addr, uint64_t len, int prot, int flags, uint64_t offset);
\ No newline at end of file
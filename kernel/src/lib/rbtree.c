@@ -0,0 +1,193 @@
+#include "rbtree.h"
+
+static inline bool rb_is_black(rb_node_t *node) {
+    return node == NULL || node->color == RB_BLACK;
+}
+
+/**
+ * @brief 把 parent 中指向 old 的孩子指针改为 new，parent 为 NULL 时 new 成为根
+ *
+ */
+static void rb_replace_child(rb_root_t *root, rb_node_t *parent, rb_node_t *old, rb_node_t *new) {
+    if (parent == NULL) root->root = new;
+    else if (parent->left == old) parent->left = new;
+    else parent->right = new;
+}
+
+/**
+ * @brief 旋转前后子树包含的节点不变，只需重新计算被旋转的两个节点（先下后上）
+ *
+ */
+static void rb_rotate_left(rb_root_t *root, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+    y->parent = x->parent;
+    rb_replace_child(root, x->parent, x, y);
+    y->left = x;
+    x->parent = y;
+    if (root->augment) {
+        root->augment(x);
+        root->augment(y);
+    }
+}
+
+static void rb_rotate_right(rb_root_t *root, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+    y->parent = x->parent;
+    rb_replace_child(root, x->parent, x, y);
+    y->right = x;
+    x->parent = y;
+    if (root->augment) {
+        root->augment(x);
+        root->augment(y);
+    }
+}
+
+void rb_propagate(rb_root_t *root, rb_node_t *node) {
+    if (root->augment == NULL) return;
+    for (; node; node = node->parent) root->augment(node);
+}
+
+void rb_insert_color(rb_root_t *root, rb_node_t *node) {
+    rb_propagate(root, node);
+    while (node->parent && node->parent->color == RB_RED) {
+        rb_node_t *parent = node->parent;
+        rb_node_t *gparent = parent->parent;   // 父节点是红色，一定不是根
+        if (parent == gparent->left) {
+            rb_node_t *uncle = gparent->right;
+            if (!rb_is_black(uncle)) {
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_right(root, gparent);
+        } else {
+            rb_node_t *uncle = gparent->left;
+            if (!rb_is_black(uncle)) {
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_left(root, gparent);
+        }
+    }
+    root->root->color = RB_BLACK;
+}
+
+/**
+ * @brief 删除黑色节点后恢复黑高；x 可能为 NULL，所以单独传入它的父节点
+ *
+ */
+static void rb_erase_color(rb_root_t *root, rb_node_t *x, rb_node_t *parent) {
+    while (x != root->root && rb_is_black(x)) {
+        if (x == parent->left) {
+            rb_node_t *w = parent->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                w = parent->right;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (rb_is_black(w->right)) {
+                w->left->color = RB_BLACK;
+                w->color = RB_RED;
+                rb_rotate_right(root, w);
+                w = parent->right;
+            }
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+        } else {
+            rb_node_t *w = parent->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                w = parent->left;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (rb_is_black(w->left)) {
+                w->right->color = RB_BLACK;
+                w->color = RB_RED;
+                rb_rotate_left(root, w);
+                w = parent->left;
+            }
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+        }
+        x = root->root;
+        break;
+    }
+    if (x) x->color = RB_BLACK;
+}
+
+void rb_erase(rb_root_t *root, rb_node_t *node) {
+    rb_node_t *x, *parent;
+    int removed_color;
+
+    if (node->left == NULL || node->right == NULL) {
+        // 至多一个孩子：孩子直接顶替 node
+        x = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_color = node->color;
+        if (x) x->parent = parent;
+        rb_replace_child(root, parent, node, x);
+    } else {
+        // 两个孩子：用后继 y 顶替 node，y 原来的右孩子 x 顶替 y
+        rb_node_t *y = node->right;
+        while (y->left) y = y->left;
+        removed_color = y->color;
+        x = y->right;
+        if (y->parent == node) {
+            parent = y;
+        } else {
+            parent = y->parent;
+            parent->left = x;
+            if (x) x->parent = parent;
+            y->right = node->right;
+            node->right->parent = y;
+        }
+        y->left = node->left;
+        node->left->parent = y;
+        y->parent = node->parent;
+        y->color = node->color;
+        rb_replace_child(root, node->parent, node, y);
+    }
+
+    // 从结构发生变化的最低处往上更新（y 在这条路径上），之后的旋转只需局部更新
+    rb_propagate(root, parent);
+    if (removed_color == RB_BLACK) rb_erase_color(root, x, parent);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "list.h"
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+// 红黑树节点，嵌入到宿主结构体中，用 rb_entry 取回宿主
+typedef struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    int color;
+} rb_node_t;
+
+// 增强回调：由 node 自身和左右孩子重新计算 node 上附加的子树信息（如子树最大值）
+typedef void (*rb_augment_t)(rb_node_t *node);
+
+typedef struct {
+    rb_node_t *root;
+    rb_augment_t augment;   // 不需要增强信息时为 NULL
+} rb_root_t;
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+/**
+ * @brief 把新节点挂到查找得到的位置，之后必须调用 rb_insert_color
+ *
+ * @param node
+ * @param parent 查找结束时的父节点，空树为 NULL
+ * @param link 父节点中指向新节点的孩子指针（空树时为 &root->root）
+ */
+static inline void rb_link_node(rb_node_t *node, rb_node_t *parent, rb_node_t **link) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+/**
+ * @brief 插入后重新着色、旋转恢复平衡，并更新新节点到根路径上的增强信息
+ *
+ * @param root
+ * @param node
+ */
+void rb_insert_color(rb_root_t *root, rb_node_t *node);
+
+/**
+ * @brief 删除节点并恢复平衡，增强信息随之更新
+ *
+ * @param root
+ * @param node
+ */
+void rb_erase(rb_root_t *root, rb_node_t *node);
+
+/**
+ * @brief node 自身决定增强信息的数据变了（树结构不变）时调用，从 node 往上逐个重新计算到根
+ *
+ * @param root
+ * @param node
+ */
+void rb_propagate(rb_root_t *root, rb_node_t *node);
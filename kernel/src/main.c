@@ -6,10 +6,12 @@
 #include "mm/debug_mm.h"
 #include "mm/pmm.h"
 #include "mm/paging.h"
+#include "mm/slab.h"
 #include "arch/x86_64.h"
 #include "proc/proc.h"
 #include "arch/timer.h"
 #include "fs/ramfs.h"
+#include "arch/acpi.h"
 
 extern pg_table_t *kernel_pml4;
 
@@ -59,6 +61,16 @@ static volatile struct limine_module_request module_request = {
     .revision = 0
 };
 
+/**
+ * @brief 请求RSDP，用于查找 ACPI 表（SRAT 等）
+ * 
+ */
+__attribute__((used,section(".limine_requests")))
+static volatile struct limine_rsdp_request rsdp_request = {
+    .id = LIMINE_RSDP_REQUEST_ID,
+    .revision = 0
+};
+
 /**
  * @brief  声明limine请求区头尾，使得limine在内核运行前处理请求区的所有请求
  *
@@ -89,8 +101,39 @@ void enable_nx() {
     wrmsr(MSR_EFER, efer | EFER_NXE);
 }
 
+// Limine 的响应都放在 BOOTLOADER_RECLAIMABLE 内存中，回收之前把还要用的信息拷贝出来
+#define BOOT_MEMMAP_MAX 256
+static struct limine_memmap_entry boot_memmap[BOOT_MEMMAP_MAX];
+static size_t boot_memmap_count = 0;
+static struct limine_file boot_init_module;
+// 启动内核栈，之后作为 idle 进程的内核栈
+static void* boot_kstack = NULL;
+
+/**
+ * @brief 保存 memmap 与 init 模块信息
+ * 
+ */
+static void save_boot_info() {
+    struct limine_memmap_response *mmap = memmap_request.response;
+    boot_memmap_count = mmap->entry_count;
+    if(boot_memmap_count > BOOT_MEMMAP_MAX) boot_memmap_count = BOOT_MEMMAP_MAX;
+    for(size_t i = 0; i < boot_memmap_count; i++) {
+        boot_memmap[i] = *mmap->entries[i];
+    }
+
+    if(module_request.response == NULL || module_request.response->module_count < 1) {
+        kprintln("Panic: init module not found!");
+        hcf();
+    }
+    // 模块内容位于 EXECUTABLE_AND_MODULES 区，不会被回收，只需拷贝描述符
+    boot_init_module = *module_request.response->modules[0];
+    boot_init_module.path = NULL;
+    boot_init_module.string = NULL;
+}
+
 void mm_init() {
     kprintln("Initializing Memory Management Subsystem...");
+    save_boot_info();
     // 获取memmap
     struct limine_memmap_response *mmap = memmap_request.response;
     // 获取hhdm_response
@@ -105,11 +148,16 @@ void mm_init() {
     kprintf("HHDM OFFSET: %lx\n",HHDM_OFFSET);
     pmm_init(mmap);
     paging_init(mmap);
+    // ACPI 表可能位于可回收内存中，必须在回收之前解析
+    acpi_init(rsdp_request.response ? (uint64_t)rsdp_request.response->address : 0);
+    numa_init();
     kheap_init(4);
+    vmm_init();
 
     // 内核栈相关
     void* ksptr = kstack_init(4*PAGE_SIZE);
     if (ksptr == NULL) hcf();
+    boot_kstack = ksptr;
 
     set_tss_stack((uint64_t)ksptr);
     kprintf("Switching stack to %lx\n", ksptr);
@@ -151,7 +199,8 @@ void kernel_init() {
     // 开启时钟中断，启动调度
     init_timer(20);
 
-    ramfs_init(0,0);
+    // init 模块作为 /init 放进 ramfs，可以直接 mmap
+    ramfs_init(boot_init_module.address, boot_init_module.size);
 }
 
 
@@ -191,26 +240,54 @@ void debug_proc() {
 }
 
 /**
- * @brief 入口
+ * @brief 运行在内核栈上的 kmain 后半部分，不再依赖任何 Limine 数据
  * 
  */
-void kmain(void) {
-    
-    kernel_init();
-    
-    struct limine_file* init_file = module_request.response->modules[0];
-    
+__attribute__((noreturn))
+static void kmain_late(void) {
+    // 引导栈、Limine 响应、引导页表都已不再使用，归还给 PMM
+    // ACPI 可回收区也在其中，先让 acpi 丢掉指向它的指针
+    acpi_release();
+    pmm_reclaim_boot_memory(boot_memmap, boot_memmap_count);
+
     // 创建第一个进程
-    init_userproc(init_file);
+    init_userproc(&boot_init_module);
+    kheap_dump_stats();
+    pgtable_dump_stats();
     __asm__ volatile ("sti");
 
     schedule(); 
 
     // 如果 schedule() 返回了，说明没有其他进程可运行，或者被抢占回来了
     kprintln("Back in kmain loop");
+    extern list_node_t ready_queue;
     while (1) {
+        // 没有就绪进程时预清零空闲页，每次一页，开中断进行
+        if(ready_queue.next == &ready_queue && pmm_zero_pool_refill()) {
+            continue;
+        }
         __asm__ volatile ("hlt");
     }
+}
+
+/**
+ * @brief 入口
+ * 
+ */
+void kmain(void) {
+    
+    kernel_init();
+
+    // 离开 Limine 的引导栈（位于可回收内存），idle 进程改用内核栈
+    extern pcb_t* idle_proc;
+    idle_proc->kstack_base = (uint64_t)boot_kstack - KSTACK_SIZE;
+    __asm__ volatile (
+        "mov %0, %%rsp\n"
+        "xor %%rbp, %%rbp\n"
+        "call *%1\n"
+        :
+        : "r"(boot_kstack), "r"(kmain_late)
+        : "memory");
     hcf();
  
 }
\ No newline at end of file
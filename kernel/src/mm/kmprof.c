@@ -0,0 +1,170 @@
+#include "kmprof.h"
+#include "../arch/x86_64.h"
+#include "../drivers/console.h"
+#include "../lib/string.h"
+
+#define SITES_MASK (KMPROF_SITES - 1)
+#define LIVE_MASK (KMPROF_LIVE - 1)
+
+bool kmprof_enabled = false;
+
+static kmprof_site_t sites[KMPROF_SITES];
+static kmprof_live_t live[KMPROF_LIVE];
+static uint64_t nr_untracked = 0;   // 表满而没有记录的分配次数
+
+// kmprof_dump 的快照，关中断拷贝之后再慢慢打印；dumping 防止两次打印同时使用它
+static kmprof_site_t snapshot[KMPROF_SITES];
+static bool dumping = false;
+
+/**
+ * @brief 乘法散列，取高位作为下标
+ *
+ */
+static inline uint32_t hash(uint64_t key, unsigned int shift) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - shift);
+}
+
+/**
+ * @brief 查找调用点，没有就占一个空槽
+ *
+ * @return int 表满返回 -1
+ */
+static int site_lookup(uint64_t caller) {
+    uint32_t i = hash(caller, KMPROF_SITES_SHIFT);
+    for(unsigned int n = 0; n < KMPROF_SITES; n++, i = (i + 1) & SITES_MASK) {
+        if(sites[i].caller == caller) return i;
+        if(sites[i].caller == 0) {
+            sites[i].caller = caller;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 从存活表中删除第 i 项：线性探测用后移删除，不留墓碑，探测链保持最短
+ *
+ */
+static void live_remove(uint32_t i) {
+    uint32_t j = i;
+    while(true) {
+        j = (j + 1) & LIVE_MASK;
+        if(live[j].ptr == 0) break;
+        uint32_t home = hash(live[j].ptr >> 4, KMPROF_LIVE_SHIFT);
+        // j 处的项探测起点不在 (i, j] 内时才能前移到 i
+        if(((j - home) & LIVE_MASK) >= ((j - i) & LIVE_MASK)) {
+            live[i] = live[j];
+            i = j;
+        }
+    }
+    live[i].ptr = 0;
+}
+
+void kmprof_alloc(void* ptr, size_t size, void* caller) {
+    uint64_t flags = irq_save();
+    int s = site_lookup((uint64_t)caller);
+    if(s < 0) {
+        nr_untracked++;
+        irq_restore(flags);
+        return;
+    }
+
+    uint32_t i = hash((uint64_t)ptr >> 4, KMPROF_LIVE_SHIFT);
+    unsigned int n;
+    for(n = 0; n < KMPROF_LIVE && live[i].ptr; n++) i = (i + 1) & LIVE_MASK;
+    if(n == KMPROF_LIVE) {
+        nr_untracked++;
+        irq_restore(flags);
+        return;
+    }
+    live[i].ptr = (uint64_t)ptr;
+    live[i].size = size;
+    live[i].site = s;
+
+    kmprof_site_t* site = &sites[s];
+    site->live_bytes += size;
+    site->live_count++;
+    site->total_allocs++;
+    if(site->live_bytes > site->peak_bytes) site->peak_bytes = site->live_bytes;
+    irq_restore(flags);
+}
+
+void kmprof_free(void* ptr) {
+    uint64_t flags = irq_save();
+    uint32_t i = hash((uint64_t)ptr >> 4, KMPROF_LIVE_SHIFT);
+    for(unsigned int n = 0; n < KMPROF_LIVE && live[i].ptr; n++, i = (i + 1) & LIVE_MASK) {
+        if(live[i].ptr != (uint64_t)ptr) continue;
+        kmprof_site_t* site = &sites[live[i].site];
+        site->live_bytes -= live[i].size;
+        site->live_count--;
+        live_remove(i);
+        break;
+    }
+    irq_restore(flags);
+}
+
+void kmprof_reset() {
+    uint64_t flags = irq_save();
+    memset(sites, 0, sizeof(sites));
+    memset(live, 0, sizeof(live));
+    nr_untracked = 0;
+    irq_restore(flags);
+}
+
+void kmprof_dump() {
+    // 关中断时只把调用点按在用字节数插入排序拷进快照，打印时不再关中断
+    uint64_t flags = irq_save();
+    if(dumping) {
+        irq_restore(flags);
+        return;
+    }
+    dumping = true;
+    unsigned int nr = 0;
+    for(unsigned int i = 0; i < KMPROF_SITES; i++) {
+        if(sites[i].caller == 0) continue;
+        unsigned int j = nr++;
+        while(j > 0 && snapshot[j - 1].live_bytes < sites[i].live_bytes) {
+            snapshot[j] = snapshot[j - 1];
+            j--;
+        }
+        snapshot[j] = sites[i];
+    }
+    bool enabled = kmprof_enabled;
+    uint64_t untracked = nr_untracked;
+    irq_restore(flags);
+
+    kprintf("kmalloc profile (%s): %d call sites, %ld untracked\n",
+        enabled ? "on" : "off", nr, untracked);
+    kprintln("  caller              live bytes  live count  total allocs  peak bytes");
+    uint64_t live_bytes = 0, peak_bytes = 0;
+    for(unsigned int k = 0; k < nr; k++) {
+        kmprof_site_t* site = &snapshot[k];
+        kprintf("  %lx  %ld  %ld  %ld  %ld\n",
+            site->caller, site->live_bytes, site->live_count, site->total_allocs, site->peak_bytes);
+        live_bytes += site->live_bytes;
+        peak_bytes += site->peak_bytes;
+    }
+    kprintf("  total: %ld bytes live, sum of peaks %ld bytes\n", live_bytes, peak_bytes);
+    dumping = false;
+}
+
+int64_t kmprof_ctl(int cmd) {
+    switch(cmd) {
+    case KMPROF_DUMP:
+        kmprof_dump();
+        return 0;
+    case KMPROF_ON:
+        // 关闭期间的 kfree 没有记录，存活表里可能留着已释放的块，重新开启时从头统计
+        if(!kmprof_enabled) kmprof_reset();
+        kmprof_enabled = true;
+        return 0;
+    case KMPROF_OFF:
+        kmprof_enabled = false;
+        return 0;
+    case KMPROF_RESET:
+        kmprof_reset();
+        return 0;
+    default:
+        return -1;
+    }
+}
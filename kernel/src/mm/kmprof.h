@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// 按调用点统计 kmalloc/kfree：调用点表记录每个调用点的在用字节数、在用块数、累计分配次数与峰值，
+// 存活表记录每个在用内存块属于哪个调用点、有多大，kfree 时据此扣减
+#define KMPROF_SITES_SHIFT 8
+#define KMPROF_SITES (1 << KMPROF_SITES_SHIFT)
+#define KMPROF_LIVE_SHIFT 12
+#define KMPROF_LIVE (1 << KMPROF_LIVE_SHIFT)
+
+// SYS_KMPROF 的命令
+#define KMPROF_DUMP  0
+#define KMPROF_ON    1
+#define KMPROF_OFF   2
+#define KMPROF_RESET 3
+
+typedef struct {
+    uint64_t caller;        // 调用 kmalloc 的返回地址，0 表示空槽
+    uint64_t live_bytes;    // 在用字节数
+    uint64_t live_count;    // 在用块数
+    uint64_t total_allocs;  // 累计分配次数
+    uint64_t peak_bytes;    // 在用字节数的峰值
+} kmprof_site_t;
+
+typedef struct {
+    uint64_t ptr;           // 内存块地址，0 表示空槽
+    uint32_t size;          // 请求的大小
+    uint32_t site;          // 所属调用点在调用点表中的下标
+} kmprof_live_t;
+
+// 关闭时 kmalloc/kfree 只多一次分支
+extern bool kmprof_enabled;
+
+/**
+ * @brief 记录一次分配
+ *
+ * @param ptr
+ * @param size
+ * @param caller
+ */
+void kmprof_alloc(void* ptr, size_t size, void* caller);
+
+/**
+ * @brief 记录一次释放，开启统计之前分配的块直接忽略。
+ *        关闭期间的释放不记录，所以 KMPROF_ON 从关闭状态重新开启时会先清空两张表
+ *
+ * @param ptr
+ */
+void kmprof_free(void* ptr);
+
+/**
+ * @brief 清空两张表
+ *
+ */
+void kmprof_reset();
+
+/**
+ * @brief 按在用字节数从大到小打印各调用点，只在拷贝快照时关中断
+ *
+ */
+void kmprof_dump();
+
+/**
+ * @brief SYS_KMPROF 的处理函数
+ *
+ * @param cmd KMPROF_DUMP / KMPROF_ON / KMPROF_OFF / KMPROF_RESET
+ * @return int64_t 未知命令返回 -1
+ */
+int64_t kmprof_ctl(int cmd);
@@ -0,0 +1,160 @@
+#include "numa.h"
+#include "pmm.h"
+#include "../arch/acpi.h"
+#include "../arch/x86_64.h"
+#include "../drivers/console.h"
+
+// SRAT (System Resource Affinity Table)
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t table_revision;
+    uint64_t reserved;
+} __attribute__((packed)) acpi_srat_t;
+
+// SRAT 子表类型
+#define SRAT_CPU_AFFINITY    0
+#define SRAT_MEM_AFFINITY    1
+#define SRAT_X2APIC_AFFINITY 2
+
+// 子表 flags bit 0：该项有效
+#define SRAT_ENABLED (1u << 0)
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) srat_entry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint8_t proximity_lo;       // 邻近域低 8 位
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t sapic_eid;
+    uint8_t proximity_hi[3];    // 邻近域高 24 位
+    uint32_t clock_domain;
+} __attribute__((packed)) srat_cpu_affinity_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint32_t proximity;
+    uint16_t reserved1;
+    uint64_t base;
+    uint64_t size;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+} __attribute__((packed)) srat_mem_affinity_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved1;
+    uint32_t proximity;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((packed)) srat_x2apic_affinity_t;
+
+// 一段属于同一节点的物理页 [start, end)
+typedef struct {
+    size_t start;
+    size_t end;
+    int nid;
+} numa_memblk_t;
+
+static numa_memblk_t memblks[NUMA_MAX_MEMBLKS];
+static int nr_memblks = 0;
+
+// 邻近域编号可能不连续，按出现顺序映射为节点号 0, 1, 2...
+static uint32_t node_pxm[MAX_NUMNODES];
+int nr_nodes = 1;
+
+static int cpu_to_node_map[NR_CPUS];
+
+/**
+ * @brief 邻近域 -> 节点号，首次出现时分配新节点号
+ * 
+ * @param pxm 
+ * @param count 已分配的节点数
+ * @return int 节点数超过 MAX_NUMNODES 时返回 -1
+ */
+static int pxm_to_nid(uint32_t pxm, int* count) {
+    for(int nid = 0; nid < *count; nid++) {
+        if(node_pxm[nid] == pxm) return nid;
+    }
+    if(*count == MAX_NUMNODES) return -1;
+    node_pxm[*count] = pxm;
+    return (*count)++;
+}
+
+int numa_node_id() {
+    return cpu_to_node_map[cpu_id()];
+}
+
+void numa_init() {
+    kprintln("===== Start init NUMA... =====");
+    acpi_srat_t* srat = (acpi_srat_t*)acpi_find_table("SRAT");
+    if(srat == NULL) {
+        kprintln("NUMA: no SRAT found, all memory on node 0");
+        return;
+    }
+
+    uint32_t bsp_apic = cpu_apic_id();
+    int bsp_nid = 0;
+    int count = 0;
+
+    uint8_t* p = (uint8_t*)srat + sizeof(acpi_srat_t);
+    uint8_t* end = (uint8_t*)srat + srat->header.length;
+    while(p + sizeof(srat_entry_t) <= end) {
+        srat_entry_t* entry = (srat_entry_t*)p;
+        if(entry->length < sizeof(srat_entry_t) || p + entry->length > end) break;
+
+        if(entry->type == SRAT_CPU_AFFINITY) {
+            srat_cpu_affinity_t* cpu = (srat_cpu_affinity_t*)p;
+            uint32_t pxm = cpu->proximity_lo | (cpu->proximity_hi[0] << 8) |
+                           (cpu->proximity_hi[1] << 16) | ((uint32_t)cpu->proximity_hi[2] << 24);
+            int nid = (cpu->flags & SRAT_ENABLED) ? pxm_to_nid(pxm, &count) : -1;
+            if(nid >= 0 && cpu->apic_id == bsp_apic) bsp_nid = nid;
+        } else if(entry->type == SRAT_X2APIC_AFFINITY) {
+            srat_x2apic_affinity_t* cpu = (srat_x2apic_affinity_t*)p;
+            int nid = (cpu->flags & SRAT_ENABLED) ? pxm_to_nid(cpu->proximity, &count) : -1;
+            if(nid >= 0 && cpu->x2apic_id == bsp_apic) bsp_nid = nid;
+        } else if(entry->type == SRAT_MEM_AFFINITY) {
+            srat_mem_affinity_t* mem = (srat_mem_affinity_t*)p;
+            int nid = (mem->flags & SRAT_ENABLED) ? pxm_to_nid(mem->proximity, &count) : -1;
+            // 超出 total_pages 的部分没有 struct page，不用管
+            size_t start = pa2pgidx(ALIGN_UP(mem->base, PAGE_SIZE));
+            size_t stop = pa2pgidx(ALIGN_DOWN(mem->base + mem->size, PAGE_SIZE));
+            if(stop > total_pages) stop = total_pages;
+            if(nid >= 0 && start < stop && nr_memblks < NUMA_MAX_MEMBLKS) {
+                memblks[nr_memblks].start = start;
+                memblks[nr_memblks].end = stop;
+                memblks[nr_memblks].nid = nid;
+                nr_memblks++;
+                kprintf("NUMA: node %d (pxm %d) %lx - %lx\n", nid, mem->proximity, pgidx2pa(start), pgidx2pa(stop));
+            }
+        }
+        p += entry->length;
+    }
+
+    if(nr_memblks == 0) {
+        kprintln("NUMA: SRAT has no usable memory affinity, all memory on node 0");
+        return;
+    }
+
+    nr_nodes = count;
+    cpu_to_node_map[cpu_id()] = bsp_nid;
+    kprintf("NUMA: %d nodes, CPU%d (APIC %d) on node %d\n", nr_nodes, cpu_id(), bsp_apic, bsp_nid);
+
+    // 节点号记进 page_t，pfn_to_nid 之后不再查 SRAT 区间；倒序写入使重叠部分以先出现的区间为准
+    for(int i = nr_memblks - 1; i >= 0; i--) {
+        for(size_t pgidx = memblks[i].start; pgidx < memblks[i].end; pgidx++) mem_map[pgidx].nid = memblks[i].nid;
+    }
+
+    // 启动阶段的页都挂在节点 0 上，按 SRAT 重新分配到各节点
+    pmm_numa_rebuild();
+    kprintln("===== Init NUMA done!!! =====");
+}
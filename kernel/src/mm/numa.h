@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// 最多支持的 NUMA 节点数
+#define MAX_NUMNODES 8
+// SRAT 中最多记录的内存区间数
+#define NUMA_MAX_MEMBLKS 32
+
+// 实际的节点数，没有 SRAT 时为 1
+extern int nr_nodes;
+
+/**
+ * @brief 解析 ACPI SRAT，建立 页号 -> 节点、CPU -> 节点 的映射，并按节点重建 buddy 空闲链表
+ *        必须在 pmm_init、paging_init、acpi_init 之后调用
+ * 
+ */
+void numa_init();
+
+/**
+ * @brief 当前 CPU 所在的节点
+ * 
+ * @return int 
+ */
+int numa_node_id();
@@ -6,8 +6,71 @@
 // 将物理地址转换成虚拟地址
 #define pa2kva(pa) (pa+HHDM_OFFSET)
 
+// 中间表项只带 P/RW/US：HUGE 放在中间表项上会被当成大页，NX 会作用于整棵子树。
+// 中间表项总是可写，权限只由叶子决定，否则同一张表下先映射的只读页会让之后的可写页也写不了
+#define pte_table_flags(flags) (PTE_PRESENT | PTE_RW | ((flags) & PTE_USER))
+
+#define pte_is_huge(e) (((e) & (PTE_PRESENT | PTE_HUGE)) == (PTE_PRESENT | PTE_HUGE))
+
 // 全局内核 PML4 指针
 pg_table_t* kernel_pml4 = NULL;
+
+// CPU 是否支持 1GiB 页（CPUID.80000001H:EDX[26]），paging_init 中检测
+bool cpu_has_1g_pages = false;
+
+bool pcid_enabled = false;
+
+// vmm_map_range 建立的各尺寸映射数
+static size_t nr_mapped_1g = 0, nr_mapped_2m = 0, nr_mapped_4k = 0;
+
+// 用户透明大页：当前映射着的 2MiB 页数、累计拆分次数
+size_t nr_user_huge = 0;
+uint64_t nr_huge_split = 0;
+
+// 页表页快表：拆除地址空间时回收的页表页（已清零），新建页表时优先取用
+static uint64_t pgtable_quicklist[PGTABLE_QUICKLIST_MAX];
+static size_t pgtable_quicklist_len = 0;
+static uint64_t pgtable_hits = 0, pgtable_misses = 0, pgtable_recycled = 0;
+
+uint64_t pgtable_alloc() {
+    uint64_t flags = irq_save();
+    if(pgtable_quicklist_len) {
+        uint64_t pa = pgtable_quicklist[--pgtable_quicklist_len];
+        pgtable_hits++;
+        irq_restore(flags);
+        return pa;
+    }
+    pgtable_misses++;
+    irq_restore(flags);
+    // 新页表必须全 0，快表为空时从预清零页池取
+    return pmm_alloc_zeroed_page();
+}
+
+void pgtable_free(uint64_t pa) {
+    uint64_t flags = irq_save();
+    if(pgtable_quicklist_len < PGTABLE_QUICKLIST_MAX) {
+        pgtable_quicklist[pgtable_quicklist_len++] = pa;
+        pgtable_recycled++;
+        irq_restore(flags);
+        return;
+    }
+    irq_restore(flags);
+    pmm_free_page(pa);
+}
+
+size_t pgtable_quicklist_shrink() {
+    uint64_t flags = irq_save();
+    size_t n = pgtable_quicklist_len;
+    while(pgtable_quicklist_len) pmm_free_page(pgtable_quicklist[--pgtable_quicklist_len]);
+    irq_restore(flags);
+    return n;
+}
+
+void pgtable_dump_stats() {
+    uint64_t total = pgtable_hits + pgtable_misses;
+    kprintf("Page tables: %ld allocs, %ld quicklist hits (%ld%%), %ld recycled, %ld cached\n",
+        total, pgtable_hits, total ? pgtable_hits * 100 / total : 0, pgtable_recycled, pgtable_quicklist_len);
+}
 /**
  * @brief 获取下一级页表指针。如果 allocate=true 且不存在，则创建之。
  * 
@@ -22,12 +85,15 @@ pg_table_t* get_next_table(pg_table_t* pgtable, uint64_t index, bool allocate,ui
 
     // 检查是否存在
     if(*entry & PTE_PRESENT) {
+        // 大页没有下一级页表，需要时由调用者先 split_huge
+        if(*entry & PTE_HUGE) return NULL;
         uintptr_t next_pa = PTE_GET_ADDR(*entry);
         return (pg_table_t*)pa2kva(next_pa);
     }
 
     if(allocate) {
-        uintptr_t newpg_pa = pmm_alloc_page();
+        // 新页表必须全 0，快表和预清零页池里的页都已清零
+        uintptr_t newpg_pa = pgtable_alloc();
         // 分配失败
         if(newpg_pa == 0) {
 
@@ -35,9 +101,8 @@ pg_table_t* get_next_table(pg_table_t* pgtable, uint64_t index, bool allocate,ui
             return NULL;
         }
 
-        // 转换成虚拟地址，并初始化为0
+        // 转换成虚拟地址
         pg_table_t* newpg_va = (pg_table_t*)pa2kva(newpg_pa);
-        memset(newpg_va, 0, PAGE_SIZE);
 
         // 设置页表项
         *entry = newpg_pa | flags;
@@ -49,6 +114,63 @@ pg_table_t* get_next_table(pg_table_t* pgtable, uint64_t index, bool allocate,ui
     return NULL;
 }
 
+/**
+ * @brief 把一个大页表项拆成下一级的 512 项，映射的内容和权限不变
+ * 
+ * @param pml4 entry 所在的页表，用来区分用户大页与内核大页
+ * @param entry 大页表项（PDPTE 或 PDE）
+ * @param va 大页范围内的任一地址，用于失效旧的大页 TLB 项
+ * @param huge_size 该表项映射的大小（1GiB 或 2MiB）
+ * @return true 
+ * @return false 分配页表失败
+ */
+static bool split_huge(pg_table_t* pml4, pte_t* entry, uintptr_t va, uint64_t huge_size) {
+    uintptr_t table_pa = pmm_alloc_page();
+    if(table_pa == 0) {
+        kprintln("Panic:OOM when splitting huge page!");
+        return false;
+    }
+    pg_table_t* table = (pg_table_t*)pa2kva(table_pa);
+    uint64_t sub_size = huge_size >> 9;
+    uint64_t base = PTE_GET_ADDR(*entry);
+    uint64_t flags = PTE_GET_FLAGS(*entry);
+    // 拆成 4KiB 页时第 7 位在 PTE 中是 PAT，必须清掉
+    if(sub_size == PAGE_SIZE) flags &= ~PTE_HUGE;
+    for(int i = 0; i < 512; i++) {
+        table->entries[i] = (base + i * sub_size) | flags;
+    }
+    *entry = table_pa | pte_table_flags(flags);
+    // 翻译结果虽然不变，但页大小变了，SDM 4.10.4.2 要求失效，否则大页项可能与新的小页项同时留在 TLB 中。
+    // invlpg 大页内任一地址会清掉该大页的全部 TLB 项（包括拆碎缓存的）和当前 PCID 的分页结构缓存；
+    // 不是当前地址空间的页表只会是还没运行过的新 mm，TLB 中没有它的项
+    invlpg((void*)ALIGN_DOWN(va, huge_size));
+    // 用户大页的 512 个子页分配时各有一次引用和映射计数，拆开后按普通小页释放即可。
+    // 与 tlb_gather_flush 一样按页表判断用户页：PROT_NONE 的用户大页清掉了 PTE_USER，仍要计入
+    if(pml4 != kernel_pml4 && va < KERNEL_HHDM_BASE && huge_size == PAGE_SIZE_2M) {
+        nr_user_huge--;
+        nr_huge_split++;
+    }
+    return true;
+}
+
+bool vmm_split_huge(pg_table_t* pml4, uintptr_t va) {
+    uint64_t size;
+    pte_t* entry = vmm_get_leaf(pml4, va, &size);
+    if(entry == NULL || size == PAGE_SIZE) return true;
+    return split_huge(pml4, entry, va, size);
+}
+
+/**
+ * @brief 释放一个用户 2MiB 页：逐页减 mapcount，引用全部归零时整块还给 buddy
+ * 
+ * @param pa 
+ */
+static void free_user_huge(uintptr_t pa) {
+    for(size_t i = 0; i < HUGE_PAGE_NR; i++) pa2page(pa + i * PAGE_SIZE)->mapcount--;
+    pmm_free_pages(pa, HUGE_PAGE_ORDER);
+    nr_user_huge--;
+}
+
 /**
  * @brief 映射虚拟地址到物理地址
  * @param pml4 顶级页表虚拟地址
@@ -56,30 +178,299 @@ pg_table_t* get_next_table(pg_table_t* pgtable, uint64_t index, bool allocate,ui
  * @param phys 物理地址
  * @param flags 标志位 (PTE_RW, PTE_USER 等)
  */
-void vmm_map_page(pg_table_t* pml4, uintptr_t va, uintptr_t pa, uint64_t flags) 
+pg_table_t* vmm_get_pt(pg_table_t* pml4, uintptr_t va, bool allocate, uint64_t flags)
 {
     // 获取索引
     uint64_t idx4 = PML4_IDX(va);
     uint64_t idx3 = PDPT_IDX(va);
     uint64_t idx2 = PD_IDX(va);
-    uint64_t idx1 = PT_IDX(va);
-
-    // 获取页表项
-    pg_table_t* pdpt = get_next_table(pml4,idx4,1,flags);
-    if (pdpt == NULL) return; // 检查分配是否失败
-    pg_table_t* pd = get_next_table(pdpt,idx3,1,flags);
-    if (pd == NULL) return; // 检查分配是否失败
-    pg_table_t* pt = get_next_table(pd,idx2,1,flags);
+
+    uint64_t tflags = pte_table_flags(flags);
+
+    // 获取页表项，需要分配时途经的大页先拆开
+    pg_table_t* pdpt = get_next_table(pml4,idx4,allocate,tflags);
+    if (pdpt == NULL) return NULL; // 检查分配是否失败
+    if (allocate && pte_is_huge(pdpt->entries[idx3]) && !split_huge(pml4, &pdpt->entries[idx3], va, PAGE_SIZE_1G)) return NULL;
+    pg_table_t* pd = get_next_table(pdpt,idx3,allocate,tflags);
+    if (pd == NULL) return NULL; // 检查分配是否失败
+    if (allocate && pte_is_huge(pd->entries[idx2]) && !split_huge(pml4, &pd->entries[idx2], va, PAGE_SIZE_2M)) return NULL;
+    return get_next_table(pd,idx2,allocate,tflags);
+}
+
+void vmm_map_page(pg_table_t* pml4, uintptr_t va, uintptr_t pa, uint64_t flags) 
+{
+    pg_table_t* pt = vmm_get_pt(pml4, va, true, flags);
     if (pt == NULL) return; // 检查分配是否失败
 
     // 设置最后一级 PTE
-    pt->entries[idx1] = pa|flags|PTE_PRESENT;
+    pt->entries[PT_IDX(va)] = pa|flags|PTE_PRESENT;
     
     // 刷新 TLB 使新的页表映射生效
     invlpg((void*)va);
 
 }
 
+bool vmm_map_huge(pg_table_t* pml4, uintptr_t va, uintptr_t pa, uint64_t page_size, uint64_t flags) {
+    uint64_t tflags = pte_table_flags(flags);
+    pg_table_t* pdpt = get_next_table(pml4, PML4_IDX(va), true, tflags);
+    if(pdpt == NULL) return false;
+
+    pte_t* entry = &pdpt->entries[PDPT_IDX(va)];
+    if(page_size == PAGE_SIZE_2M) {
+        if(pte_is_huge(*entry) && !split_huge(pml4, entry, va, PAGE_SIZE_1G)) return false;
+        pg_table_t* pd = get_next_table(pdpt, PDPT_IDX(va), true, tflags);
+        if(pd == NULL) return false;
+        entry = &pd->entries[PD_IDX(va)];
+    }
+    // 这一段已经有下一级页表时不覆盖，由调用者改用小页
+    if((*entry & PTE_PRESENT) && !(*entry & PTE_HUGE)) return false;
+
+    *entry = pa | flags | PTE_HUGE | PTE_PRESENT;
+    invlpg((void*)va);
+    return true;
+}
+
+/**
+ * @brief va、pa 都按 size 对齐且剩余长度够一整页时才能用该尺寸的页
+ * 
+ */
+static inline bool huge_fits(uintptr_t va, uintptr_t pa, uintptr_t end, uint64_t size) {
+    return ((va | pa) & (size - 1)) == 0 && end - va >= size;
+}
+
+void vmm_map_range(pg_table_t* pml4, uintptr_t va, uintptr_t pa, uint64_t len, uint64_t flags) {
+    uintptr_t end = va + len;
+    while(va < end) {
+        uint64_t size;
+        if(cpu_has_1g_pages && huge_fits(va, pa, end, PAGE_SIZE_1G)
+            && vmm_map_huge(pml4, va, pa, PAGE_SIZE_1G, flags)) {
+            size = PAGE_SIZE_1G;
+            nr_mapped_1g++;
+        } else if(huge_fits(va, pa, end, PAGE_SIZE_2M)
+            && vmm_map_huge(pml4, va, pa, PAGE_SIZE_2M, flags)) {
+            size = PAGE_SIZE_2M;
+            nr_mapped_2m++;
+        } else {
+            // 4KiB 页：走一次表，填到这张页表覆盖的 2MiB 末尾（下一个可能用大页的边界）或区间末尾
+            pg_table_t* pt = vmm_get_pt(pml4, va, true, flags);
+            if(pt == NULL) return;
+            uintptr_t stop = ALIGN_DOWN(va, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+            if(stop > end) stop = end;
+            size = stop - va;
+            for(uintptr_t cur = va; cur < stop; cur += PAGE_SIZE) {
+                pte_t* entry = &pt->entries[PT_IDX(cur)];
+                // 只有覆盖原有映射时才可能有旧的 TLB 项
+                bool was_present = *entry & PTE_PRESENT;
+                *entry = (pa + (cur - va)) | flags | PTE_PRESENT;
+                if(was_present) invlpg((void*)cur);
+                nr_mapped_4k++;
+            }
+        }
+        va += size;
+        pa += size;
+    }
+}
+
+size_t vmm_map_alloc(pg_table_t* pml4, uintptr_t va, size_t npages, uint64_t flags,
+                     uint64_t (*alloc_frame)(int), int nid) {
+    size_t done = 0;
+    while(done < npages) {
+        uintptr_t cur = va + done * PAGE_SIZE;
+        pg_table_t* pt = vmm_get_pt(pml4, cur, true, flags);
+        if(pt == NULL) break;
+        // 同一张页表内按下标连续填写
+        for(unsigned int i = PT_IDX(cur); i < 512 && done < npages; i++, done++) {
+            uint64_t pa = alloc_frame(nid);
+            if(pa == 0) return done;
+            if(flags & PTE_USER) {
+                pa2page(pa)->mapcount++;
+                pa2page(pa)->flags |= PG_anon;
+            }
+            // 原先不存在的表项不会被 TLB 缓存，无需 invlpg
+            pt->entries[i] = pa | flags | PTE_PRESENT;
+        }
+    }
+    return done;
+}
+
+size_t vmm_unmap_range(pg_table_t* pml4, uintptr_t va, size_t npages, tlb_gather_t* tlb) {
+    size_t done = 0, unmapped = 0;
+    while(done < npages) {
+        uintptr_t cur = va + done * PAGE_SIZE;
+        unsigned int idx = PT_IDX(cur);
+        pg_table_t* pt = vmm_get_pt(pml4, cur, false, 0);
+        if(pt == NULL) {
+            uint64_t size;
+            pte_t* leaf = vmm_get_leaf(pml4, cur, &size);
+            if(leaf != NULL && size == PAGE_SIZE_2M) {
+                // 整个 2MiB 页都在范围内就整项清掉，否则先拆成小页再按 4KiB 解除
+                if(idx == 0 && npages - done >= 512) {
+                    pte_t entry = *leaf;
+                    *leaf = 0;
+                    tlb_gather_add(tlb, cur, entry);
+                    done += 512;
+                    unmapped += 512;
+                    continue;
+                }
+                if(split_huge(pml4, leaf, cur, PAGE_SIZE_2M)) continue;
+            }
+            // 整张页表都不存在，跳到下一张
+            done += 512 - idx;
+            continue;
+        }
+        for(; idx < 512 && done < npages; idx++, done++, cur += PAGE_SIZE) {
+            pte_t entry = pt->entries[idx];
+            if(!(entry & PTE_PRESENT)) continue;
+            pt->entries[idx] = 0;
+            tlb_gather_add(tlb, cur, entry);
+            unmapped++;
+        }
+    }
+    return unmapped;
+}
+
+void tlb_gather_init(tlb_gather_t* tlb, pg_table_t* pml4) {
+    tlb->pml4 = pml4;
+    tlb->start = UINTPTR_MAX;
+    tlb->end = 0;
+    tlb->nr_entries = 0;
+    tlb->nr_tables = 0;
+    tlb->stale = false;
+}
+
+/**
+ * @brief 使收集到的地址范围失效：范围小就逐页 invlpg，大就整体刷新
+ * 
+ * @param tlb 
+ */
+static void tlb_gather_invalidate(tlb_gather_t* tlb) {
+    if(tlb->start >= tlb->end) return;
+    // 内核高半部分所有地址空间共享，总能就地失效；用户地址只有页表正在使用时才能
+    bool kernel = tlb->start >= KERNEL_HHDM_BASE;
+    bool current = kernel || (rcr3() & ~CR3_PCID_MASK) == (uint64_t)tlb->pml4 - HHDM_OFFSET;
+    if(!current) {
+        tlb->stale = true;
+    } else if((tlb->end - tlb->start) / PAGE_SIZE > TLB_FLUSH_ALL_PAGES) {
+        // 内核映射是全局页，加载 CR3 刷不掉
+        if(kernel) tlb_flush_all();
+        else lcr3(rcr3());
+    } else {
+        for(uintptr_t va = tlb->start; va < tlb->end; va += PAGE_SIZE) invlpg((void*)va);
+    }
+    tlb->start = UINTPTR_MAX;
+    tlb->end = 0;
+}
+
+void tlb_gather_flush(tlb_gather_t* tlb) {
+    // 先失效再释放，保证物理页被重新分配时没有残留的翻译
+    tlb_gather_invalidate(tlb);
+    // 按页表判断用户页：PROT_NONE 的用户页清掉了 PTE_USER，但仍要按用户页释放
+    bool user = tlb->pml4 != kernel_pml4;
+    for(size_t i = 0; i < tlb->nr_entries; i++) {
+        pte_t entry = tlb->entries[i];
+        uintptr_t pa = PTE_GET_ADDR(entry);
+        if(user) {
+            if(entry & PTE_HUGE) {
+                free_user_huge(pa);
+                continue;
+            }
+            // 用户页可能被多个地址空间共享，只释放本页表持有的那一次引用
+            page_t* page = pa2page(pa);
+            page->mapcount--;
+            put_page(page);
+        } else {
+            pmm_free_page(pa);
+        }
+    }
+    tlb->nr_entries = 0;
+    // 页表页也可能留在分页结构缓存中，同样要等失效之后才能重用；取下之前已经是全 0
+    for(size_t i = 0; i < tlb->nr_tables; i++) pgtable_free(tlb->tables[i]);
+    tlb->nr_tables = 0;
+}
+
+void tlb_gather_add(tlb_gather_t* tlb, uintptr_t va, pte_t entry) {
+    // 只记地址时 entry 为 0；带 PTE_HUGE 的表项由 vmm_unmap_range 从 PD 中取下，覆盖 2MiB
+    uint64_t size = (entry & PTE_HUGE) ? PAGE_SIZE_2M : PAGE_SIZE;
+    if(va < tlb->start) tlb->start = va;
+    if(va + size > tlb->end) tlb->end = va + size;
+    if(!(entry & PTE_PRESENT)) return;
+    tlb->entries[tlb->nr_entries++] = entry;
+    if(tlb->nr_entries == TLB_GATHER_BATCH) tlb_gather_flush(tlb);
+}
+
+void tlb_gather_range(tlb_gather_t* tlb, uintptr_t start, uintptr_t end) {
+    if(start < tlb->start) tlb->start = start;
+    if(end > tlb->end) tlb->end = end;
+}
+
+/**
+ * @brief 记录一张从上级表项中取下的页表页，失效后放回快表
+ * 
+ * @param va 该页表覆盖的任一地址，invlpg 它会连带清掉分页结构缓存
+ */
+static void tlb_gather_table(tlb_gather_t* tlb, uintptr_t va, uintptr_t pa) {
+    tlb_gather_range(tlb, va, va + PAGE_SIZE);
+    tlb->tables[tlb->nr_tables++] = pa;
+    if(tlb->nr_tables == TLB_GATHER_TABLES) tlb_gather_flush(tlb);
+}
+
+static bool pgtable_empty(pg_table_t* table) {
+    for(int i = 0; i < 512; i++) {
+        if(table->entries[i]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 释放 table 下整个位于 [start, end) 内且已经为空的下级页表
+ * 
+ * @param level table 的级别 (4 = PML4, 3 = PDPT, 2 = PD)
+ * @param base table 覆盖的起始地址
+ */
+static void free_pgtables_level(pg_table_t* table, int level, uintptr_t base,
+                                uintptr_t start, uintptr_t end, tlb_gather_t* tlb) {
+    // 每一项覆盖的大小：PML4 512GiB，PDPT 1GiB，PD 2MiB
+    uint64_t size = 1ULL << (12 + 9 * (level - 1));
+    unsigned int first = (start > base) ? (start - base) / size : 0;
+    for(unsigned int i = first; i < 512; i++) {
+        uintptr_t child = base + i * size;
+        if(child >= end) break;
+        pte_t entry = table->entries[i];
+        if(!(entry & PTE_PRESENT) || (entry & PTE_HUGE)) continue;
+        pg_table_t* next = (pg_table_t*)pa2kva(PTE_GET_ADDR(entry));
+        if(level > 2) free_pgtables_level(next, level - 1, child, start, end, tlb);
+        // 只部分落在范围内的页表可能还被范围外的映射使用，留着不动
+        if(child < start || child + size > end || !pgtable_empty(next)) continue;
+        table->entries[i] = 0;
+        tlb_gather_table(tlb, child, PTE_GET_ADDR(entry));
+    }
+}
+
+void vmm_free_pgtables(pg_table_t* pml4, uintptr_t start, uintptr_t end, tlb_gather_t* tlb) {
+    free_pgtables_level(pml4, 4, 0, start, end, tlb);
+}
+
+pte_t* vmm_get_leaf(pg_table_t* pml4, uintptr_t va, uint64_t* page_size) {
+    pg_table_t* pdpt = get_next_table(pml4, PML4_IDX(va), false, 0);
+    if (pdpt == NULL) return NULL;
+    pte_t* entry = &pdpt->entries[PDPT_IDX(va)];
+    if (pte_is_huge(*entry)) {
+        if (page_size) *page_size = PAGE_SIZE_1G;
+        return entry;
+    }
+    pg_table_t* pd = get_next_table(pdpt, PDPT_IDX(va), false, 0);
+    if (pd == NULL) return NULL;
+    entry = &pd->entries[PD_IDX(va)];
+    if (pte_is_huge(*entry)) {
+        if (page_size) *page_size = PAGE_SIZE_2M;
+        return entry;
+    }
+    pg_table_t* pt = get_next_table(pd, PD_IDX(va), false, 0);
+    if (pt == NULL) return NULL;
+    if (page_size) *page_size = PAGE_SIZE;
+    return &pt->entries[PT_IDX(va)];
+}
+
 // 获取内核（可执行文件）在物理内存和虚拟内存中的加载基地址。
 __attribute__((used, section(".limine_requests"))) 
 static volatile struct limine_executable_address_request kernel_addr_request = {
@@ -88,19 +479,10 @@ static volatile struct limine_executable_address_request kernel_addr_request = {
 };
 
 pte_t* vmm_get_pte(pg_table_t* pml4, uintptr_t va) {
-    uint64_t idx4 = PML4_IDX(va);
-    uint64_t idx3 = PDPT_IDX(va);
-    uint64_t idx2 = PD_IDX(va);
-    uint64_t idx1 = PT_IDX(va);
-
-    pg_table_t* pdpt = get_next_table(pml4, idx4, false, 0);
-    if (pdpt == NULL) return NULL;
-    pg_table_t* pd = get_next_table(pdpt, idx3, false, 0);
-    if (pd == NULL) return NULL;
-    pg_table_t* pt = get_next_table(pd, idx2, false, 0);
+    pg_table_t* pt = vmm_get_pt(pml4, va, false, 0);
     if (pt == NULL) return NULL;
 
-    return &pt->entries[idx1];
+    return &pt->entries[PT_IDX(va)];
 }
 
 // 递归释放用户页表及其对应的物理页
@@ -111,6 +493,12 @@ void user_pgtable_free_recursive(pg_table_t* pgtable,int level)
     for(int i=0;i<limit;i++) {
         pte_t entry = pgtable->entries[i];
         if(entry & PTE_PRESENT) {
+            if(level == 2 && (entry & PTE_HUGE)) {
+                // 透明大页没有下一级页表
+                free_user_huge(PTE_GET_ADDR(entry));
+                pgtable->entries[i] = 0;
+                continue;
+            }
             if(level > 1) {
                 // 递归释放下一级页表
                 uintptr_t next_pa = PTE_GET_ADDR(entry);
@@ -118,8 +506,18 @@ void user_pgtable_free_recursive(pg_table_t* pgtable,int level)
                 user_pgtable_free_recursive(next_table, level - 1);
             }
             // 释放当前页表项对应的物理页
+            // 叶子页可能被多个地址空间共享，只释放本页表持有的那一次引用
             uintptr_t pa = PTE_GET_ADDR(entry);
-            pmm_free_page(pa);
+            if(level == 1) {
+                page_t* page = pa2page(pa);
+                page->mapcount--;
+                put_page(page);
+            } else {
+                // 下一级页表在递归中已逐项清零，可以直接放回快表
+                pgtable_free(pa);
+            }
+            // 顺手清零本项，遍历结束时整张表即为全 0
+            pgtable->entries[i] = 0;
         }
     }
 }
@@ -139,6 +537,9 @@ void paging_init(struct limine_memmap_response* mmap) {
 
     kprintf("Kernel PML4 allocated at PA: %lx, VA: %lx\n", pml4_pa, (uintptr_t)kernel_pml4);
 
+    cpu_has_1g_pages = cpu_has_pdpe1gb();
+    kprintf("1GiB pages %s\n", cpu_has_1g_pages ? "supported" : "not supported");
+
     // 获取内核空间
     uintptr_t k_start_va = (uintptr_t)__kernel_start;
     uintptr_t k_end_va   = (uintptr_t)__kernel_end;
@@ -156,10 +557,8 @@ void paging_init(struct limine_memmap_response* mmap) {
     uintptr_t kva_base = kaddr->virtual_base;
     uint64_t kpa_base = kaddr->physical_base;
     
-    // 映射内核空间（映射整个加载区域）
-    for(uint64_t i = 0; i < kernel_size; i += PAGE_SIZE) {
-        vmm_map_page(kernel_pml4, kva_base + i, kpa_base + i, PTE_PRESENT | PTE_RW);
-    }
+    // 映射内核空间（映射整个加载区域），对齐允许时用 2MiB 页
+    vmm_map_range(kernel_pml4, kva_base, kpa_base, kernel_size, PTE_KERNEL);
     kprintln("Kernel mapped...");
 
     // 映射HHDM空间访问物理内存
@@ -175,6 +574,7 @@ void paging_init(struct limine_memmap_response* mmap) {
         if (entry->type == LIMINE_MEMMAP_USABLE ||
             entry->type == LIMINE_MEMMAP_EXECUTABLE_AND_MODULES ||
             entry->type == LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE ||
+            entry->type == LIMINE_MEMMAP_ACPI_RECLAIMABLE ||
             entry->type == LIMINE_MEMMAP_FRAMEBUFFER) {
             
             uintptr_t start = ALIGN_DOWN(entry->base, PAGE_SIZE);
@@ -182,24 +582,30 @@ void paging_init(struct limine_memmap_response* mmap) {
 
             kprintf("Mapping region: %lx - %lx\n", start, end);
 
-            for (uintptr_t pa = start; pa < end; pa += PAGE_SIZE) {
-                // 使用 4KB 映射
-                vmm_map_page(kernel_pml4, pa + HHDM_OFFSET, pa, PTE_PRESENT | PTE_RW);
-            }
+            // 对齐的部分用 1GiB/2MiB 页，两端不足一个大页的部分用 4KB 页
+            vmm_map_range(kernel_pml4, start + HHDM_OFFSET, start, end - start, PTE_KERNEL);
 
-            // 恒等映射前 4GB 物理内存
+            // 恒等映射前 4GB 物理内存（虚拟地址 == 物理地址）
             if(start >= identity_end) continue;
             if(end > identity_end) end = identity_end;
-            for (uintptr_t pa = start; pa < end; pa += PAGE_SIZE) {
-                // 虚拟地址 == 物理地址
-                vmm_map_page(kernel_pml4, pa, pa, PTE_PRESENT | PTE_RW);
-            }
+            vmm_map_range(kernel_pml4, start, start, end - start, PTE_PRESENT | PTE_RW);
         }
     }
     
-    kprintln("HHDM mapped...");
+    kprintf("HHDM mapped: %ld x 1GiB, %ld x 2MiB, %ld x 4KiB pages\n", nr_mapped_1g, nr_mapped_2m, nr_mapped_4k);
 
     // 加载到cr3
     lcr3(pml4_pa);
+    // 开启全局页；写 CR4.PGE 同时清掉引导页表留下的全局 TLB 项
+    lcr4(rcr4() & ~CR4_PGE);
+    lcr4(rcr4() | CR4_PGE);
+    // CR0.WP：内核写只读的用户页同样触发缺页，系统调用写入写时复制的页时才会复制
+    lcr0(rcr0() | CR0_WP);
+    // 开启 PCID：此时 CR3[11:0] 为 0，满足置位 CR4.PCIDE 的要求
+    if(cpu_has_pcid()) {
+        lcr4(rcr4() | CR4_PCIDE);
+        pcid_enabled = true;
+    }
+    kprintf("PCID %s\n", pcid_enabled ? "enabled" : "not supported");
     kprintln("===== PAGING Init Done! CR3 switched. =====");
 }
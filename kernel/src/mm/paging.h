@@ -13,6 +13,8 @@ typedef uint64_t pdpte_t;
 typedef uint64_t pml4e_t;
 
 #define PAGE_SIZE 4096
+#define PAGE_SIZE_2M (1ull << 21)
+#define PAGE_SIZE_1G (1ull << 30)
 // ==========================================
 // 页表项标志位 (Page Table Entry Flags)
 // ==========================================
@@ -60,6 +62,10 @@ typedef uint64_t pml4e_t;
 // 需要在 EFER MSR 寄存器开启 NXE 位才生效，否则触发 #GP
 #define PTE_NX (1ull << 63)
 
+// 内核高半部分的映射：所有地址空间共享，标为全局页，切换 CR3 时保留在 TLB 中
+// 低半部分的恒等映射只在 kernel_pml4 中存在，不能标为全局
+#define PTE_KERNEL (PTE_PRESENT | PTE_RW | PTE_GLOBAL)
+
 // ==========================================
 //  辅助宏 / Helper Functions
 // ==========================================
@@ -103,6 +109,14 @@ typedef struct
  */
 pg_table_t *get_next_table(pg_table_t *pgtable, uint64_t index, bool allocate, uint64_t flags);
 
+/**
+ * @brief 走一次页表拿到 va 所在的最后一级页表，覆盖同一个 2MiB 的 512 页之后按 PT_IDX 直接访问
+ * @param allocate 中间页表不存在时是否创建；创建时途经的大页会被拆开，否则遇到大页返回 NULL
+ * @param flags 映射标志，中间表项只取其中的 P/RW/US
+ * @return pg_table_t* 
+ */
+pg_table_t *vmm_get_pt(pg_table_t *pml4, uintptr_t va, bool allocate, uint64_t flags);
+
 /**
  * @brief 映射虚拟地址到物理地址
  * @param pml4 顶级页表虚拟地址
@@ -112,6 +126,98 @@ pg_table_t *get_next_table(pg_table_t *pgtable, uint64_t index, bool allocate, u
  */
 void vmm_map_page(pg_table_t *pml4, uintptr_t va, uintptr_t pa, uint64_t flags);
 
+// CPU 是否支持 1GiB 页
+extern bool cpu_has_1g_pages;
+
+// 是否已开启 CR4.PCIDE，未开启时 switch_mm 退化为普通的 lcr3
+extern bool pcid_enabled;
+
+/**
+ * @brief 用一个 2MiB (PDE) 或 1GiB (PDPTE) 大页映射，va、pa 须按 page_size 对齐
+ * @param page_size PAGE_SIZE_2M 或 PAGE_SIZE_1G
+ * @return bool 该位置已有下一级页表或分配失败时返回 false，不做映射
+ */
+bool vmm_map_huge(pg_table_t *pml4, uintptr_t va, uintptr_t pa, uint64_t page_size, uint64_t flags);
+
+// 当前映射着的用户 2MiB 页数（透明大页）与累计拆分次数
+extern size_t nr_user_huge;
+extern uint64_t nr_huge_split;
+
+/**
+ * @brief 把 va 所在的大页拆成下一级的小页，映射内容和权限不变；部分解除映射或修改权限前调用
+ * @return bool va 不在大页中时直接返回 true，分配页表失败返回 false
+ */
+bool vmm_split_huge(pg_table_t *pml4, uintptr_t va);
+
+/**
+ * @brief 映射一段连续的物理内存，对齐允许时用 1GiB/2MiB 大页，其余用 4KiB 页
+ * @param len 须按 PAGE_SIZE 对齐
+ */
+void vmm_map_range(pg_table_t *pml4, uintptr_t va, uintptr_t pa, uint64_t len, uint64_t flags);
+
+/**
+ * @brief 为 [va, va + npages 页) 逐页分配物理页并映射，每张页表只走一次；该范围原先须未映射
+ *        带 PTE_USER 时为每页记一次 mapcount
+ * @param alloc_frame 分配物理页的函数，如 pmm_alloc_page_node / pmm_alloc_zeroed_page_node
+ * @param nid 传给 alloc_frame 的节点号
+ * @return size_t 成功映射的页数，小于 npages 表示内存不足
+ */
+size_t vmm_map_alloc(pg_table_t *pml4, uintptr_t va, size_t npages, uint64_t flags,
+                     uint64_t (*alloc_frame)(int), int nid);
+
+// 一批最多收集多少个待释放的表项
+#define TLB_GATHER_BATCH 64
+// 待失效的范围超过这么多页时整体刷新 TLB，不再逐页 invlpg
+#define TLB_FLUSH_ALL_PAGES 32
+// 一次最多攒多少张待释放的页表页
+#define TLB_GATHER_TABLES 16
+
+/**
+ * @brief 解除映射时收集待失效的地址和待释放的物理页，攒够一批或结束时一次失效、再一起释放
+ */
+typedef struct {
+    pg_table_t* pml4;
+    uintptr_t start, end;               // 待失效的地址范围
+    size_t nr_entries;
+    pte_t entries[TLB_GATHER_BATCH];    // 被清掉的表项，失效后释放其物理页
+    size_t nr_tables;
+    uint64_t tables[TLB_GATHER_TABLES]; // 被取下的页表页，失效后放回快表
+    bool stale;     // 页表不是当前地址空间的，invlpg 够不着，调用者须作废该地址空间的 TLB
+} tlb_gather_t;
+
+void tlb_gather_init(tlb_gather_t *tlb, pg_table_t *pml4);
+
+/**
+ * @brief 记录一个被清掉的表项；entry 不含 PTE_PRESENT 时只记地址，不释放物理页
+ *        用户页（PTE_USER）减 mapcount 后 put_page，用户 2MiB 页整块释放，内核页 pmm_free_page
+ */
+void tlb_gather_add(tlb_gather_t *tlb, uintptr_t va, pte_t entry);
+
+/**
+ * @brief 使收集到的地址失效并释放物理页，结束时必须调用
+ */
+void tlb_gather_flush(tlb_gather_t *tlb);
+
+/**
+ * @brief 只把 [start, end) 并入待失效的地址范围，用于就地修改了权限的表项
+ * 
+ */
+void tlb_gather_range(tlb_gather_t *tlb, uintptr_t start, uintptr_t end);
+
+/**
+ * @brief 解除 [va, va + npages 页) 的映射，每张页表只走一次，表项交给 tlb 处理
+ *        完整落在范围内的 2MiB 页整项解除，只覆盖一部分的先拆成 4KiB 页
+ * @return size_t 解除映射的页数
+ */
+size_t vmm_unmap_range(pg_table_t *pml4, uintptr_t va, size_t npages, tlb_gather_t *tlb);
+
+/**
+ * @brief 释放整个落在 [start, end) 内的空页表（PT/PD/PDPT），在 tlb 刷新时放回快表
+ *        只用于用户地址，调用前应已解除范围内的映射
+ * 
+ */
+void vmm_free_pgtables(pg_table_t *pml4, uintptr_t start, uintptr_t end, tlb_gather_t *tlb);
+
 /**
  * @brief 初始化分页机制，建立内核页表并加载到 CR3
  * @param mmap 指向 Limine 提供的内存映射响应结构体
@@ -126,6 +232,39 @@ void paging_init(struct limine_memmap_response *mmap);
  */
 pte_t *vmm_get_pte(pg_table_t *pml4, uintptr_t va);
 
+/**
+ * @brief 获取虚拟地址所在的最后一级表项，可能是 4KiB 的 PTE，也可能是大页的 PDE/PDPTE
+ * @param page_size 输出：该表项映射的大小，可为 NULL
+ * @return pte_t* 表项指针，找不到则返回 NULL
+ */
+pte_t *vmm_get_leaf(pg_table_t *pml4, uintptr_t va, uint64_t *page_size);
+
+// 页表页快表的容量，多出来的页表页直接还给 PMM
+#define PGTABLE_QUICKLIST_MAX 64
+
+/**
+ * @brief 分配一张全 0 的页表页，优先取快表
+ * @return uint64_t 物理地址，失败返回 0
+ */
+uint64_t pgtable_alloc();
+
+/**
+ * @brief 释放一张页表页；调用者须保证它已全 0，快表满了就还给 PMM
+ * @param pa
+ */
+void pgtable_free(uint64_t pa);
+
+/**
+ * @brief 把快表中的页表页全部还给 PMM（内存紧张时调用）
+ * @return size_t 归还的页数
+ */
+size_t pgtable_quicklist_shrink();
+
+/**
+ * @brief 打印页表页的分配次数与快表命中率
+ */
+void pgtable_dump_stats();
+
 /**
  * @brief 释放一个页表及其所有下级页表
  * @param table 页表虚拟地址
@@ -1,4 +1,8 @@
 #include "pmm.h"
+#include "vmm.h"
+#include "slab.h"
+#include "vmalloc.h"
+#include "kmprof.h"
 #include "../drivers/console.h"
 #include "../arch/x86_64.h"
 
@@ -6,20 +10,59 @@
 uint64_t HHDM_OFFSET = 0;
 
 // 定义全局变量
-uint8_t* bitmap = NULL;             // 位图数组的虚拟地址
+uint64_t* bitmap = NULL;            // 位图数组的虚拟地址（叶子层，1 = 占用）
+uint64_t* bitmap_summary = NULL;    // 摘要层：每个字对应 64 个叶子字
 size_t bitmap_size = 0;             // 位图占用的字节数
+size_t bitmap_words = 0;            // 叶子层字数
+size_t summary_words = 0;           // 摘要层字数
 size_t total_pages = 0;             // 物理内存总页数
 size_t free_pages = 0;              // 当前空闲页数（统计用）
-size_t last_free_index = 0;         // 优化变量，下次分配时从这里开始扫描
 uint64_t kstack_ptr = KERNEL_STACK_BASE;  // 内核栈指针
 
+// 位图查找统计：查找次数与读取的字数
+uint64_t bitmap_lookups = 0;
+uint64_t bitmap_words_scanned = 0;
+
+// 各节点的 buddy 空闲链表，链接各空闲块首页的 page_t
+pmm_node_t pmm_nodes[MAX_NUMNODES];
+
+// 物理页描述符数组，紧跟在位图后面
+page_t* mem_map = NULL;
+
+/**
+ * @brief 统计 64 位字中 1 的个数（内核不链接 libgcc，不能用 __builtin_popcountll）
+ * 
+ * @param x 
+ * @return size_t 
+ */
+static inline size_t popcount64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/**
+ * @brief 叶子字 word 改变后同步摘要位：叶子字还有空闲位时摘要位为 1
+ * 
+ * @param word 叶子字下标
+ */
+static inline void summary_update(size_t word) {
+    if(bitmap[word] == ~0ULL) {
+        bitmap_summary[word / 64] &= ~(1ULL << (word % 64));
+    } else {
+        bitmap_summary[word / 64] |= 1ULL << (word % 64);
+    }
+}
+
 /**
  * @brief 将bitmap的bit位设置成1
  * 
  * @param bit 
  */
 void bit_set(size_t bit) {
-    bitmap[bit / 8] |= (1 << (bit % 8));
+    bitmap[bit / 64] |= 1ULL << (bit % 64);
+    summary_update(bit / 64);
 }
 
 
@@ -29,7 +72,8 @@ void bit_set(size_t bit) {
  * @param bit 
  */
 void bit_unset(size_t bit) {
-    bitmap[bit / 8] &= ~(1 << (bit % 8));
+    bitmap[bit / 64] &= ~(1ULL << (bit % 64));
+    summary_update(bit / 64);
 }
 
 /**
@@ -38,7 +82,89 @@ void bit_unset(size_t bit) {
  * @param bit 
  */
 bool bit_test(size_t bit) {
-    return bitmap[bit / 8] & (1 << (bit % 8));
+    return bitmap[bit / 64] & (1ULL << (bit % 64));
+}
+
+/**
+ * @brief 按字批量设置 [start, start+num) 的位，返回实际发生翻转的位数
+ * 
+ * @param start 起始位
+ * @param num 位数
+ * @param busy true 置 1（占用），false 清 0（空闲）
+ * @return size_t 
+ */
+static size_t bitmap_fill(size_t start, size_t num, bool busy) {
+    size_t flipped = 0;
+    size_t end = start + num;
+    while(start < end) {
+        size_t word = start / 64;
+        size_t lo = start % 64;
+        size_t hi = (end - word * 64 < 64) ? end - word * 64 : 64;
+        uint64_t mask = (hi - lo == 64) ? ~0ULL : (((1ULL << (hi - lo)) - 1) << lo);
+        uint64_t old = bitmap[word];
+        bitmap[word] = busy ? (old | mask) : (old & ~mask);
+        flipped += popcount64(old ^ bitmap[word]);
+        summary_update(word);
+        start = word * 64 + hi;
+    }
+    return flipped;
+}
+
+/**
+ * @brief 查找 from 及之后的第一个空闲页：先看当前叶子字，再借助摘要层跳过全满的叶子字
+ * 
+ * @param from 起始页号
+ * @return size_t 空闲页号，找不到返回 total_pages
+ */
+size_t pmm_bitmap_find_free(size_t from) {
+    if(from >= total_pages) return total_pages;
+    bitmap_lookups++;
+
+    size_t word = from / 64;
+    uint64_t avail = ~bitmap[word] & (~0ULL << (from % 64));
+    bitmap_words_scanned++;
+    if(avail) {
+        size_t bit = word * 64 + __builtin_ctzll(avail);
+        return bit < total_pages ? bit : total_pages;
+    }
+
+    // 在摘要层中找下一个含空闲位的叶子字
+    word++;
+    for(size_t s = word / 64; s < summary_words; s++) {
+        uint64_t sum = bitmap_summary[s];
+        if(s == word / 64) sum &= (word % 64) ? (~0ULL << (word % 64)) : ~0ULL;
+        bitmap_words_scanned++;
+        if(sum) {
+            size_t leaf = s * 64 + __builtin_ctzll(sum);
+            bitmap_words_scanned++;
+            size_t bit = leaf * 64 + __builtin_ctzll(~bitmap[leaf]);
+            return bit < total_pages ? bit : total_pages;
+        }
+    }
+    return total_pages;
+}
+
+/**
+ * @brief 查找 from 及之后的第一个占用页，按字跳过全空闲的叶子字
+ * 
+ * @param from 起始页号
+ * @return size_t 占用页号，找不到返回 total_pages
+ */
+size_t pmm_bitmap_find_busy(size_t from) {
+    if(from >= total_pages) return total_pages;
+    bitmap_lookups++;
+
+    size_t word = from / 64;
+    uint64_t busy = bitmap[word] & (~0ULL << (from % 64));
+    bitmap_words_scanned++;
+    while(!busy) {
+        word++;
+        if(word >= bitmap_words) return total_pages;
+        busy = bitmap[word];
+        bitmap_words_scanned++;
+    }
+    size_t bit = word * 64 + __builtin_ctzll(busy);
+    return bit < total_pages ? bit : total_pages;
 }
 
 /**
@@ -50,16 +176,11 @@ bool bit_test(size_t bit) {
 void pmm_set_free(uintptr_t pa,size_t pgnum) {
     size_t pgidx = pa2pgidx(pa);
     // 越界
-    if(pgidx+pgnum>=total_pages) {
+    if(pgidx+pgnum>total_pages) {
         return;
     }
 
-    for(size_t i=0;i<pgnum;i++) {
-        if(bit_test(pgidx+i)) {
-            bit_unset(pgidx+i);
-            free_pages++;
-        }
-    }
+    free_pages += bitmap_fill(pgidx, pgnum, false);
 }
 /**
  * @brief 将bitmap中从pa开始的pgnum个物理块标志成预留
@@ -70,119 +191,985 @@ void pmm_set_free(uintptr_t pa,size_t pgnum) {
 void pmm_set_busy(uintptr_t pa,size_t pgnum) {
     size_t pgidx = pa2pgidx(pa);
     // 越界
-    if(pgidx+pgnum>=total_pages) {
+    if(pgidx+pgnum>total_pages) {
         return;
     }
 
-    for(size_t i=0;i<pgnum;i++) {
-        if(!bit_test(pgidx+i)) {
-            bit_set(pgidx+i);
-            free_pages--;
-        }
-    }
+    free_pages -= bitmap_fill(pgidx, pgnum, true);
 }
 
 static list_node_t kheap_list; // 堆块全局管理链表
 static uint64_t kheap_top = KERNEL_HEAP_BASE;     // 追踪堆当前的虚拟地址边界
+size_t kheap_resident_pages = 0;    // 首次适配堆当前映射着物理页的页数
+size_t kheap_used_bytes = 0;        // 首次适配堆中已分配出去的字节数（不含块头）
+uint64_t kheap_trimmed_pages = 0;   // 累计归还 PMM 的堆页数
+
+// kheap_trim 在堆中间解除映射后留下的地址区间，kheap_expand 先从这里取，取不到才抬高堆顶
+#define KHEAP_MAX_HOLES 32
+typedef struct {
+    uint64_t start;
+    size_t pgnum;
+} kheap_hole_t;
+static kheap_hole_t kheap_holes[KHEAP_MAX_HOLES];
+static int kheap_nr_holes = 0;
+
+
 
 
+void pcp_drain_all();
+size_t pcp_cached_pages();
 
+static inline list_node_t* pgidx2node(size_t pgidx) {
+    return &mem_map[pgidx].list;
+}
+
+static inline size_t node2pgidx(list_node_t* node) {
+    return container_of(node, page_t, list) - mem_map;
+}
 
 /**
- * @brief next_fit算法分配空闲物理页框
+ * @brief 将以 pgidx 为首页的 order 阶空闲块挂入空闲链表
  * 
- * @return uint64_t 
+ * @param pgidx 
+ * @param order 
  */
-uint64_t pmm_alloc_page() {
+static void buddy_push(size_t pgidx, unsigned int order) {
+    pmm_node_t* node = &pmm_nodes[pfn_to_nid(pgidx)];
+    list_add_after(pgidx2node(pgidx), &node->free_area[order]);
+    mem_map[pgidx].flags |= PG_buddy;
+    mem_map[pgidx].private = order;
+    node->free_area_count[order]++;
+    node->free_pages += 1UL << order;
+}
 
-    // 0. 如果没有空闲页，直接返回，避免无效遍历
-    // 1. 第一轮搜索：从上次的位置往后找
-    // 2. 第二轮搜索：如果后面满了，回绕从头(0)找
-    // 3. 真的找不到（虽然理论上前面判断了 free_pages > 0 不会进这里）
-    
-    if(free_pages == 0) {
-        kprintln("ERROR: No free pages available for allocation!");
+/**
+ * @brief 将以 pgidx 为首页的 order 阶空闲块从空闲链表摘下
+ * 
+ * @param pgidx 
+ * @param order 
+ */
+static void buddy_remove(size_t pgidx, unsigned int order) {
+    pmm_node_t* node = &pmm_nodes[pfn_to_nid(pgidx)];
+    list_del(pgidx2node(pgidx));
+    mem_map[pgidx].flags &= ~PG_buddy;
+    mem_map[pgidx].private = 0;
+    node->free_area_count[order]--;
+    node->free_pages -= 1UL << order;
+}
+
+/**
+ * @brief 将一段连续空闲页拆成尽可能大的自然对齐块挂入 buddy（初始化用）
+ * 
+ * @param pgidx 起始页号
+ * @param pgnum 页数
+ */
+static void buddy_add_range(size_t pgidx, size_t pgnum) {
+    size_t end = pgidx + pgnum;
+    while(pgidx < end) {
+        unsigned int order = MAX_ORDER - 1;
+        while(order > 0 && ((pgidx & ((1UL << order) - 1)) || pgidx + (1UL << order) > end)) {
+            order--;
+        }
+        buddy_push(pgidx, order);
+        pgidx += 1UL << order;
+    }
+}
+
+unsigned int get_order(size_t size) {
+    size_t pgnum = ALIGN_UP(size, PAGE_SIZE) / PAGE_SIZE;
+    unsigned int order = 0;
+    while((1UL << order) < pgnum) {
+        order++;
+    }
+    return order;
+}
+
+/**
+ * @brief 在一个节点内用buddy算法分配 2^order 个连续物理页框（不打印错误，不回收页缓存）
+ * 
+ * @param node 
+ * @param order 
+ * @return uint64_t 
+ */
+static uint64_t buddy_alloc_node(pmm_node_t* node, unsigned int order) {
+    unsigned int cur = order;
+    while(cur < MAX_ORDER && node->free_area[cur].next == &node->free_area[cur]) {
+        cur++;
+    }
+    if(cur == MAX_ORDER) {
         return 0;
     }
-    
-    for(size_t i = last_free_index; i < total_pages; i++) {
-        // 发现该位是 0 (Free)
-        if(!bit_test(i)) {
-            bit_set(i);
-            free_pages -= 1;
-            last_free_index = i + 1;
-            // kprintf("PMM Alloc: %lx\n", pgidx2pa(i));
-            return pgidx2pa(i);
+
+    size_t pgidx = node2pgidx(node->free_area[cur].next);
+    buddy_remove(pgidx, cur);
+
+    while(cur > order) {
+        cur--;
+        buddy_push(pgidx + (1UL << cur), cur);
+    }
+
+    size_t pgnum = 1UL << order;
+    bitmap_fill(pgidx, pgnum, true);
+    free_pages -= pgnum;
+    for(size_t i = 0; i < pgnum; i++) {
+        page_t* page = &mem_map[pgidx + i];
+        page->refcount = 1;
+        page->mapcount = 0;
+        page->flags = 0;
+        page->private = 0;
+    }
+    return pgidx2pa(pgidx);
+}
+
+/**
+ * @brief 优先在节点 nid 中分配，不足时按节点号依次尝试其他节点
+ * 
+ * @param nid 
+ * @param order 
+ * @return uint64_t 
+ */
+static uint64_t buddy_alloc(int nid, unsigned int order) {
+    for(int i = 0; i < nr_nodes; i++) {
+        uint64_t pa = buddy_alloc_node(&pmm_nodes[(nid + i) % nr_nodes], order);
+        if(pa) return pa;
+    }
+    return 0;
+}
+
+/**
+ * @brief 记录一次分配是否落在请求的节点上
+ * 
+ * @param nid 请求的节点
+ * @param pa 
+ * @param pgnum 
+ */
+static inline void node_account(int nid, uint64_t pa, size_t pgnum) {
+    if(pfn_to_nid(pa2pgidx(pa)) == nid) {
+        pmm_nodes[nid].alloc_local += pgnum;
+    } else {
+        pmm_nodes[nid].alloc_fallback += pgnum;
+    }
+}
+
+/**
+ * @brief 将引用计数已降为 0 的块归还 buddy，并与伙伴块逐级合并
+ * 
+ * @param pgidx 
+ * @param order 
+ */
+static void buddy_free(size_t pgidx, unsigned int order) {
+    bitmap_fill(pgidx, 1UL << order, false);
+    free_pages += 1UL << order;
+
+    // 块不跨节点：伙伴在其他节点上时不合并
+    int nid = pfn_to_nid(pgidx);
+    while(order < MAX_ORDER - 1) {
+        size_t buddy = pgidx ^ (1UL << order);
+        if(buddy >= total_pages || !(mem_map[buddy].flags & PG_buddy) || mem_map[buddy].private != order
+           || pfn_to_nid(buddy) != nid) {
+            break;
         }
+        buddy_remove(buddy, order);
+        pgidx &= ~(1UL << order);
+        order++;
     }
+    buddy_push(pgidx, order);
+}
 
-    for(size_t i = 0; i < last_free_index; i++) {
-        // 发现该位是 0 (Free)
-        if(!bit_test(i)) {
-            bit_set(i);
-            free_pages -= 1;
-            last_free_index = i + 1;
-            // kprintf("PMM Alloc: %lx\n", pgidx2pa(i));
-            return pgidx2pa(i);
+/**
+ * @brief 把一个特定的空闲页从所在的 buddy 块中摘出，块的其余部分逐级拆分挂回空闲链表
+ * 
+ * @param pgidx 空闲页号（位图中为空闲）
+ * @return true 
+ * @return false pgidx 不在任何空闲块中
+ */
+static bool buddy_isolate(size_t pgidx) {
+    size_t head = pgidx;
+    unsigned int order = 0;
+    for(; order < MAX_ORDER; order++) {
+        head = pgidx & ~((1UL << order) - 1);
+        if((mem_map[head].flags & PG_buddy) && mem_map[head].private == order) break;
+    }
+    if(order == MAX_ORDER) return false;
+
+    buddy_remove(head, order);
+    while(order > 0) {
+        order--;
+        size_t half = 1UL << order;
+        if(pgidx >= head + half) {
+            buddy_push(head, order);
+            head += half;
+        } else {
+            buddy_push(head + half, order);
         }
     }
 
-    kprintln("ERROR: Failed to allocate page (allocation loop failed)!");
-    return 0;
+    bitmap_fill(pgidx, 1, true);
+    free_pages--;
+    return true;
+}
+
+// 预清零页池（定义见后文），内存紧张时作为最后的后备
+static uint64_t zero_pool_take(int nid);
+static size_t zero_pool_drain();
+
+uint64_t pmm_alloc_pages(unsigned int order) {
+    return pmm_alloc_pages_node(numa_node_id(), order);
+}
+
+uint64_t pmm_alloc_pages_node(int nid, unsigned int order) {
+    // 1. 从 order 阶开始向上找第一个非空的空闲链表
+    // 2. 摘下该块，逐级对半拆分，把高半部分挂回低一阶链表
+    // 3. 标记 bitmap 为占用
+    if(order >= MAX_ORDER) {
+        kprintf("ERROR: pmm_alloc_pages order %d too large!\n", order);
+        return 0;
+    }
+
+    uint64_t flags = irq_save();
+    uint64_t pa = buddy_alloc(nid, order);
+    if(!pa) {
+        // 预清零池、页表快表和各 CPU 缓存中的页可能恰好挡住了伙伴合并，全部归还后重试
+        size_t released = zero_pool_drain() + pgtable_quicklist_shrink();
+        if(released || pcp_cached_pages() > 0) {
+            pcp_drain_all();
+            pa = buddy_alloc(nid, order);
+        }
+    }
+    if(pa) node_account(nid, pa, 1UL << order);
+    irq_restore(flags);
+
+    if(!pa) kprintf("ERROR: No free block of order %d available for allocation!\n", order);
+    return pa;
 }
 
 /**
- * @brief 释放物理地址pa对应的物理页框
+ * @brief 释放 2^order 个连续物理页框的引用，全部降为 0 时整块归还并与伙伴块逐级合并
  * 
  * @param pa 
+ * @param order 
  */
-void pmm_free_page(uint64_t pa) {
-    // 1. 越界检查
-    // 2. 双重释放检查 (Optional, but good for debug)
-    // 3. 执行释放
-    // 4. 游标回退优化（next_fit）
+void pmm_free_pages(uint64_t pa, unsigned int order) {
+    // 1. 越界与对齐检查
+    // 2. 双重释放检查
+    // 3. 逐页释放引用
+    // 4. 整块都没有引用了则整块归还，否则只归还降为 0 的页
     size_t pgidx = pa2pgidx(pa);
-    if(pgidx >= total_pages) {
+    if(order >= MAX_ORDER || pgidx + (1UL << order) > total_pages) {
         kprintln("Trying to free invalid address(pg>totalpages)");
         return;
     }
 
-    if(!bit_test(pgidx)) {
+    size_t pgnum = 1UL << order;
+    if(pgidx & (pgnum - 1)) {
+        kprintln("Trying to free misaligned buddy block");
+        return;
+    }
+
+    uint64_t flags = irq_save();
+    for(size_t i = 0; i < pgnum; i++) {
+        page_t* page = &mem_map[pgidx + i];
+        if(page->refcount <= 0 || (page->flags & PG_reserved)) {
+            irq_restore(flags);
+            kprintln("double free detected");
+            return;
+        }
+    }
+
+    size_t released = 0;
+    for(size_t i = 0; i < pgnum; i++) {
+        if(--mem_map[pgidx + i].refcount == 0) released++;
+    }
+
+    if(released == pgnum) {
+        buddy_free(pgidx, order);
+    } else {
+        for(size_t i = 0; i < pgnum; i++) {
+            if(mem_map[pgidx + i].refcount == 0) buddy_free(pgidx + i, 0);
+        }
+    }
+    irq_restore(flags);
+}
+
+//************************************************** */
+//*************   per-CPU 页缓存 (magazine) ******** */
+//************************************************** */
+
+// 每个 CPU 缓存一批 order-0 页，快速路径只访问本 CPU 数据（关中断即可），
+// 批量地从 buddy 补充 / 归还。
+// hot：刚释放的页，大概率还在 CPU cache 中，优先分配（LIFO）
+// cold：从 buddy 批量取来的页或调用方声明不再热的页，hot 用完后才使用
+// 缓存中的页在位图里仍是 busy，但引用计数为 0；只缓存本 CPU 所在节点的页
+#define PCP_HOT_MAX  64
+#define PCP_COLD_MAX 64
+#define PCP_BATCH_ORDER 4
+#define PCP_BATCH (1 << PCP_BATCH_ORDER)
+
+typedef struct {
+    uint64_t hot[PCP_HOT_MAX];
+    uint64_t cold[PCP_COLD_MAX];
+    int hot_count;
+    int cold_count;
+    uint64_t alloc_hits;    // 直接由缓存满足的分配次数
+    uint64_t refills;       // 从 buddy 补充的批次数
+    uint64_t drains;        // 归还给 buddy 的批次数
+} pcp_cache_t;
+
+static pcp_cache_t pcp_caches[NR_CPUS];
+
+/**
+ * @brief 从 buddy 批量补充 cold 页：优先取一整块 PCP_BATCH 页，不行再逐页取
+ * 
+ * @param pcp 
+ */
+static void pcp_refill(pcp_cache_t* pcp) {
+    pmm_node_t* node = &pmm_nodes[numa_node_id()];
+    uint64_t pa = buddy_alloc_node(node, PCP_BATCH_ORDER);
+    if(pa) {
+        for(int i = PCP_BATCH - 1; i >= 0; i--) {
+            uint64_t page_pa = pa + (uint64_t)i * PAGE_SIZE;
+            pa2page(page_pa)->refcount = 0;
+            pcp->cold[pcp->cold_count++] = page_pa;
+        }
+    } else {
+        while(pcp->cold_count < PCP_BATCH && free_pages > 0) {
+            pa = buddy_alloc_node(node, 0);
+            if(!pa) break;
+            pa2page(pa)->refcount = 0;
+            pcp->cold[pcp->cold_count++] = pa;
+        }
+    }
+    pcp->refills++;
+}
+
+/**
+ * @brief 把 hot 栈底（最久未用）的一批页归还给 buddy
+ * 
+ * @param pcp 
+ */
+static void pcp_drain_hot(pcp_cache_t* pcp) {
+    int n = pcp->hot_count < PCP_BATCH ? pcp->hot_count : PCP_BATCH;
+    for(int i = 0; i < n; i++) {
+        buddy_free(pa2pgidx(pcp->hot[i]), 0);
+    }
+    for(int i = n; i < pcp->hot_count; i++) {
+        pcp->hot[i - n] = pcp->hot[i];
+    }
+    pcp->hot_count -= n;
+    pcp->drains++;
+}
+
+void pcp_drain_all() {
+    uint64_t flags = irq_save();
+    for(int cpu = 0; cpu < NR_CPUS; cpu++) {
+        pcp_cache_t* pcp = &pcp_caches[cpu];
+        for(int i = 0; i < pcp->hot_count; i++) buddy_free(pa2pgidx(pcp->hot[i]), 0);
+        for(int i = 0; i < pcp->cold_count; i++) buddy_free(pa2pgidx(pcp->cold[i]), 0);
+        if(pcp->hot_count || pcp->cold_count) pcp->drains++;
+        pcp->hot_count = 0;
+        pcp->cold_count = 0;
+    }
+    irq_restore(flags);
+}
+
+size_t pcp_cached_pages() {
+    size_t total = 0;
+    for(int cpu = 0; cpu < NR_CPUS; cpu++) {
+        total += pcp_caches[cpu].hot_count + pcp_caches[cpu].cold_count;
+    }
+    return total;
+}
+
+uint64_t pmm_alloc_page() {
+    return pmm_alloc_page_node(numa_node_id());
+}
+
+uint64_t pmm_alloc_page_node(int nid) {
+    uint64_t flags = irq_save();
+    pcp_cache_t* pcp = &pcp_caches[cpu_id()];
+    uint64_t pa = 0;
+
+    if(nid != numa_node_id()) {
+        // 远端节点不经过本 CPU 的页缓存
+        pa = buddy_alloc(nid, 0);
+    } else if(pcp->hot_count) {
+        pa = pcp->hot[--pcp->hot_count];
+        pcp->alloc_hits++;
+    } else if(pcp->cold_count) {
+        pa = pcp->cold[--pcp->cold_count];
+        pcp->alloc_hits++;
+    } else {
+        pcp_refill(pcp);
+        if(pcp->cold_count) pa = pcp->cold[--pcp->cold_count];
+        // 本节点已经耗尽，退到其他节点
+        if(!pa) pa = buddy_alloc(nid, 0);
+    }
+    if(!pa) pa = zero_pool_take(-1);
+
+    if(pa) {
+        node_account(nid, pa, 1);
+        page_t* page = pa2page(pa);
+        page->refcount = 1;
+        page->mapcount = 0;
+        page->flags = 0;
+        page->private = 0;
+    }
+
+    irq_restore(flags);
+    if(!pa) kprintln("ERROR: No free pages available for allocation!");
+    return pa;
+}
+
+/**
+ * @brief 引用计数已降为 0 的页放入本 CPU 缓存；超出容量时先把一批旧页归还 buddy
+ * 
+ * @param pa 
+ * @param cold 
+ */
+static void pcp_free(uint64_t pa, bool cold) {
+    uint64_t flags = irq_save();
+    pcp_cache_t* pcp = &pcp_caches[cpu_id()];
+    if(pfn_to_nid(pa2pgidx(pa)) != numa_node_id()) {
+        buddy_free(pa2pgidx(pa), 0);
+    } else if(cold) {
+        if(pcp->cold_count == PCP_COLD_MAX) {
+            buddy_free(pa2pgidx(pa), 0);
+        } else {
+            pcp->cold[pcp->cold_count++] = pa;
+        }
+    } else {
+        if(pcp->hot_count == PCP_HOT_MAX) {
+            pcp_drain_hot(pcp);
+        }
+        pcp->hot[pcp->hot_count++] = pa;
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief 释放一次引用，最后一个引用释放时页进入 pcp 缓存
+ * 
+ * @param page 
+ * @param cold 
+ */
+static void __put_page(page_t* page, bool cold) {
+    if(page->flags & PG_reserved) return;
+    if(page->refcount <= 0) {
         kprintln("double free detected");
         return;
     }
+    if(--page->refcount == 0) {
+        pcp_free(page2pa(page), cold);
+    }
+}
+
+void get_page(page_t* page) {
+    if(page->flags & PG_reserved) return;
+    page->refcount++;
+}
+
+void put_page(page_t* page) {
+    __put_page(page, false);
+}
+
+/**
+ * @brief 检查 pa 是否是 PMM 管理范围内的页对齐地址
+ * 
+ * @param pa 
+ * @return true 
+ * @return false 
+ */
+static bool pmm_check_pa(uint64_t pa) {
+    if(pa2pgidx(pa) >= total_pages || (pa & (PAGE_SIZE - 1))) {
+        kprintln("Trying to free invalid address(pg>totalpages)");
+        return false;
+    }
+    return true;
+}
+
+void pmm_free_page(uint64_t pa) {
+    if(pmm_check_pa(pa)) __put_page(pa2page(pa), false);
+}
+
+void pmm_free_page_cold(uint64_t pa) {
+    if(pmm_check_pa(pa)) __put_page(pa2page(pa), true);
+}
+
+//****************************************** */
+//**              预清零页池                  */
+//****************************************** */
+
+// idle 进程在就绪队列为空时预先清零一批页，分配页表、文件缓冲、用户页时直接取用，
+// 把清零从关键路径上移走。池中的页已分配（引用计数 1），内容全 0
+#define ZERO_POOL_MAX 128
+// 空闲页少于该值时不再补充，把内存留给真正的分配
+#define ZERO_POOL_MIN_FREE (ZERO_POOL_MAX * 4)
+
+static uint64_t zero_pool[ZERO_POOL_MAX];
+static int zero_pool_count = 0;
+uint64_t zero_pool_hits = 0;
+uint64_t zero_pool_misses = 0;
+
+/**
+ * @brief 从池中取一页（优先最近清零的），池中没有合适的页返回 0
+ * 
+ * @param nid 只取该节点的页，-1 表示任意节点
+ * @return uint64_t 
+ */
+static uint64_t zero_pool_take(int nid) {
+    uint64_t pa = 0;
+    uint64_t flags = irq_save();
+    for(int i = zero_pool_count - 1; i >= 0; i--) {
+        if(nid >= 0 && pfn_to_nid(pa2pgidx(zero_pool[i])) != nid) continue;
+        pa = zero_pool[i];
+        zero_pool[i] = zero_pool[--zero_pool_count];
+        break;
+    }
+    irq_restore(flags);
+    return pa;
+}
+
+/**
+ * @brief 把池中所有页还给 PMM
+ * 
+ * @return size_t 归还的页数
+ */
+static size_t zero_pool_drain() {
+    size_t n = 0;
+    uint64_t pa;
+    while((pa = zero_pool_take(-1)) != 0) {
+        pmm_free_page(pa);
+        n++;
+    }
+    return n;
+}
+
+uint64_t pmm_alloc_zeroed_page() {
+    return pmm_alloc_zeroed_page_node(numa_node_id());
+}
+
+uint64_t pmm_alloc_zeroed_page_node(int nid) {
+    uint64_t pa = zero_pool_take(nid);
+    if(pa) {
+        zero_pool_hits++;
+        pmm_nodes[nid].alloc_local++;
+        return pa;
+    }
+
+    zero_pool_misses++;
+    pa = pmm_alloc_page_node(nid);
+    if(pa) memset((void*)(pa + HHDM_OFFSET), 0, PAGE_SIZE);
+    return pa;
+}
+
+bool pmm_zero_pool_refill() {
+    if(zero_pool_count >= ZERO_POOL_MAX || free_pages < ZERO_POOL_MIN_FREE) return false;
+
+    uint64_t pa = pmm_alloc_page();
+    if(!pa) return false;
+    // 清零期间保持开中断，随时可以被抢占
+    memset((void*)(pa + HHDM_OFFSET), 0, PAGE_SIZE);
+
+    uint64_t flags = irq_save();
+    if(zero_pool_count < ZERO_POOL_MAX) {
+        zero_pool[zero_pool_count++] = pa;
+        pa = 0;
+    }
+    irq_restore(flags);
+    if(pa) pmm_free_page(pa);
+    return true;
+}
+
+//****************************************** */
+//**          连续物理页分配与内存规整          */
+//****************************************** */
+
+uint64_t contig_allocs = 0;
+uint64_t contig_fallbacks = 0;
+uint64_t compact_runs = 0;
+uint64_t compact_pages_migrated = 0;
+uint64_t compact_failures = 0;
+
+/**
+ * @brief 只被一个 4KiB 用户页表项映射、没有其他引用的匿名页可以迁移；
+ *        透明大页的子页、slab 页、文件页都不带 PG_anon
+ * 
+ * @param page 
+ * @return true 
+ * @return false 
+ */
+static inline bool page_movable(page_t* page) {
+    return (page->flags & PG_anon) && page->refcount == 1 && page->mapcount == 1;
+}
+
+/**
+ * @brief 按 step 步进扫描 npages 页的窗口：优先完全空闲的窗口，
+ *        否则选占用页最少、且占用页全部可迁移的窗口，摘下空闲页后迁移其中的用户页
+ * 
+ * @param npages 
+ * @param step 对齐页数
+ * @return uint64_t 
+ */
+static uint64_t contig_alloc_window(size_t npages, size_t step) {
+    size_t best = total_pages;
+    size_t best_busy = (size_t)-1;
+
+    size_t start = 0;
+    while(start + npages <= total_pages) {
+        size_t end = start + npages;
+        size_t busy = 0;
+        size_t blocker = total_pages;
+        for(size_t i = pmm_bitmap_find_busy(start); i < end; i = pmm_bitmap_find_busy(i + 1)) {
+            if(!page_movable(&mem_map[i])) {
+                blocker = i;
+                break;
+            }
+            busy++;
+        }
+        // 不可移动的页挡住了所有包含它的窗口，直接跳到它之后的第一个对齐位置
+        if(blocker < total_pages) {
+            start = ALIGN_UP(blocker + 1, step);
+            continue;
+        }
+        if(busy < best_busy) {
+            best = start;
+            best_busy = busy;
+            if(busy == 0) break;
+        }
+        start += step;
+    }
+    if(best == total_pages) return 0;
+
+    size_t end = best + npages;
+    if(best_busy) compact_runs++;
+
+    // 1. 先把窗口内的空闲页摘出 buddy，迁移时新页就不会落回窗口里
+    for(size_t i = best; i < end; i++) {
+        if(!bit_test(i) && buddy_isolate(i)) mem_map[i].flags |= PG_isolated;
+    }
+    // 2. 迁移窗口内的用户页，旧页留给本次分配
+    if(best_busy) compact_pages_migrated += mm_migrate_range(best, end);
+
+    bool ok = true;
+    for(size_t i = best; i < end; i++) {
+        if(!(mem_map[i].flags & PG_isolated)) {
+            ok = false;
+            break;
+        }
+    }
+
+    // 3. 全部占下则交给调用者；否则把已占下的页还给 buddy
+    for(size_t i = best; i < end; i++) {
+        page_t* page = &mem_map[i];
+        if(!(page->flags & PG_isolated)) continue;
+        page->flags = 0;
+        page->mapcount = 0;
+        page->private = 0;
+        if(ok) {
+            page->refcount = 1;
+        } else {
+            page->refcount = 0;
+            buddy_free(i, 0);
+        }
+    }
+    if(!ok) {
+        compact_failures++;
+        return 0;
+    }
+    return pgidx2pa(best);
+}
+
+uint64_t pmm_alloc_contig(size_t npages, size_t align) {
+    // 1. 块大小不小于 align 时 buddy 块天然满足对齐，多出的尾部页还给 buddy
+    // 2. 归还各级缓存后重试
+    // 3. 扫描对齐窗口，必要时迁移用户页
+    if(npages == 0) return 0;
+    if(align < PAGE_SIZE) align = PAGE_SIZE;
+    if(align & (align - 1)) {
+        kprintf("ERROR: pmm_alloc_contig align %lx is not a power of two!\n", align);
+        return 0;
+    }
+
+    uint64_t flags = irq_save();
+    int nid = numa_node_id();
+    unsigned int order = get_order(npages * PAGE_SIZE);
+    bool use_buddy = order < MAX_ORDER && ((uint64_t)PAGE_SIZE << order) >= align;
+    uint64_t pa = 0;
+    if(use_buddy) {
+        pa = buddy_alloc(nid, order);
+    }
+    if(!pa) {
+        zero_pool_drain();
+        pgtable_quicklist_shrink();
+        pcp_drain_all();
+        if(use_buddy) pa = buddy_alloc(nid, order);
+    }
+    if(pa) {
+        size_t pgidx = pa2pgidx(pa);
+        for(size_t i = npages; i < (1UL << order); i++) {
+            mem_map[pgidx + i].refcount = 0;
+            buddy_free(pgidx + i, 0);
+        }
+    } else {
+        contig_fallbacks++;
+        pa = contig_alloc_window(npages, align / PAGE_SIZE);
+    }
+    if(pa) {
+        contig_allocs++;
+        node_account(nid, pa, npages);
+    }
+    irq_restore(flags);
+
+    if(!pa) kprintf("ERROR: No contiguous range of %ld pages (align %lx) available!\n", npages, align);
+    return pa;
+}
+
+size_t pmm_frag_index(unsigned int order) {
+    if(free_pages == 0 || order >= MAX_ORDER) return 0;
+    size_t usable = 0;
+    for(int nid = 0; nid < nr_nodes; nid++) {
+        for(unsigned int o = order; o < MAX_ORDER; o++) {
+            usable += pmm_nodes[nid].free_area_count[o] << o;
+        }
+    }
+    return (free_pages - usable) * 1000 / free_pages;
+}
 
-    bit_unset(pgidx);
-    free_pages += 1;
+void pmm_dump_stats() {
+    kprintf("PMM: %ld / %ld pages free\n", free_pages, total_pages);
+    for(int nid = 0; nid < nr_nodes; nid++) {
+        pmm_node_t* node = &pmm_nodes[nid];
+        kprintf("Node %d: %ld pages free, local allocs %ld, fallback allocs %ld\n",
+            nid, node->free_pages, node->alloc_local, node->alloc_fallback);
+        kprint("  Buddy blocks per order:");
+        for(unsigned int order = 0; order < MAX_ORDER; order++) {
+            kprintf(" %ld", node->free_area_count[order]);
+        }
+        kprint("\n");
+    }
+    // 内核禁用了浮点，按百分之一精度打印平均值
+    uint64_t avg = bitmap_lookups ? bitmap_words_scanned * 100 / bitmap_lookups : 0;
+    kprintf("Bitmap lookups: %ld, words scanned: %ld, avg %ld.%ld%ld words/lookup\n",
+        bitmap_lookups, bitmap_words_scanned, avg / 100, (avg / 10) % 10, avg % 10);
+    for(int cpu = 0; cpu < NR_CPUS; cpu++) {
+        pcp_cache_t* pcp = &pcp_caches[cpu];
+        if(!pcp->refills) continue;
+        kprintf("CPU%d page cache: hot %d, cold %d, hits %ld, refills %ld, drains %ld\n",
+            cpu, pcp->hot_count, pcp->cold_count, pcp->alloc_hits, pcp->refills, pcp->drains);
+    }
+    kprintf("Zeroed page pool: %d pages, hits %ld, misses %ld\n",
+        zero_pool_count, zero_pool_hits, zero_pool_misses);
+    size_t frag = pmm_frag_index(HUGE_PAGE_ORDER);
+    kprintf("Fragmentation index (order %d): %ld.%ld%%\n", HUGE_PAGE_ORDER, frag / 10, frag % 10);
+    kprintf("Contig allocs: %ld (fallbacks %ld), compaction runs %ld, migrated %ld, failed %ld\n",
+        contig_allocs, contig_fallbacks, compact_runs, compact_pages_migrated, compact_failures);
+}
 
-    if(pgidx < last_free_index)
-        last_free_index = pgidx;
+size_t pmm_reclaim_boot_memory(const struct limine_memmap_entry* entries, size_t count) {
+    size_t reclaimed = 0;
+    for(size_t i = 0; i < count; i++) {
+        const struct limine_memmap_entry* e = &entries[i];
+        if(e->type != LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE &&
+           e->type != LIMINE_MEMMAP_ACPI_RECLAIMABLE) {
+            continue;
+        }
+        size_t start = pa2pgidx(ALIGN_UP(e->base, PAGE_SIZE));
+        size_t end = pa2pgidx(ALIGN_DOWN(e->base + e->length, PAGE_SIZE));
+        if(end > total_pages) end = total_pages;
 
-    return;
+        size_t n = 0;
+        uint64_t flags = irq_save();
+        for(size_t pgidx = start; pgidx < end; pgidx++) {
+            page_t* page = &mem_map[pgidx];
+            // 只回收仍处于保留状态的页：0 号页永不分配，条目重叠时也不会重复释放
+            if(pgidx == 0 || !(page->flags & PG_reserved)) continue;
+            page->flags = 0;
+            page->refcount = 0;
+            buddy_free(pgidx, 0);
+            n++;
+        }
+        irq_restore(flags);
 
+        kprintf("Reclaimed %s area %lx - %lx (%ld pages)\n",
+                e->type == LIMINE_MEMMAP_ACPI_RECLAIMABLE ? "ACPI" : "bootloader",
+                e->base, e->base + e->length, n);
+        reclaimed += n;
+    }
+    kprintf("Reclaimed %ld pages (%ld KiB) of boot memory\n", reclaimed, reclaimed * PAGE_SIZE / 1024);
+    return reclaimed;
+}
+
+/**
+ * @brief 把块标记为空闲，并与地址相邻的空闲块合并
+ * 
+ * @param hdr 
+ * @return kheap_pghdr_t* 合并后的块
+ */
+static kheap_pghdr_t* kheap_free_block(kheap_pghdr_t* hdr) {
+    hdr->is_free = 1;
+    list_node_t * next_node = hdr->node.next;
+    list_node_t * prev_node = hdr->node.prev;
+
+    // 向后合并
+    if(next_node != &kheap_list) {
+        kheap_pghdr_t* next= (kheap_pghdr_t*) next_node;
+        if(next->is_free && (uint64_t)hdr + hdr->size + HEADER_SIZE == (uint64_t)next) {
+            hdr->size += next->size + HEADER_SIZE;
+            list_del(next_node);
+        }
+    }
+
+    // 向前合并
+    if(prev_node != &kheap_list) {
+        kheap_pghdr_t* prev=(kheap_pghdr_t*) prev_node;
+        if(prev->is_free && (uint64_t)prev + prev->size +HEADER_SIZE == (uint64_t)hdr) {
+            prev->size += hdr->size + HEADER_SIZE;
+            list_del(&hdr->node);
+            hdr = prev;
+        }
+    }
+    return hdr;
 }
 
 extern pg_table_t* kernel_pml4;
-bool kheap_expand(size_t pgnum) {
-    for(size_t i=0;i<pgnum;i++) {
-        uint64_t pa = pmm_alloc_page();
-        if(pa==0) return false;
-        // 映射在页表中映射内核堆虚拟地址
-        vmm_map_page(kernel_pml4,kheap_top,pa,PTE_PRESENT | PTE_RW);
-        // 设置空闲内核堆块内存头
-        kheap_pghdr_t* pghdr=(kheap_pghdr_t*) kheap_top;
-        pghdr->is_free=0;
-        pghdr->size = PAGE_SIZE-HEADER_SIZE;
-        // 将新页加入循环链表的“末尾”
-        list_add_before(&pghdr->node,&kheap_list);
-
-        // 调用 kfree 逻辑会自动将它们合并成一个大的空闲块
-        kfree((void*)((uint64_t)pghdr+HEADER_SIZE));
-
-        // 更新堆顶指针
-        kheap_top += PAGE_SIZE;
+/**
+ * @brief 记下一段在堆中间解除了映射的地址区间，与相邻的空洞合并
+ * 
+ * @return bool 空洞表已满时返回 false，调用者不应解除这段映射
+ */
+static bool kheap_hole_add(uint64_t start, size_t pgnum) {
+    uint64_t end = start + pgnum * PAGE_SIZE;
+    int merged = -1;
+    for(int i = 0; i < kheap_nr_holes; i++) {
+        kheap_hole_t* hole = &kheap_holes[i];
+        if(hole->start + hole->pgnum * PAGE_SIZE == start) {
+            hole->pgnum += pgnum;
+            merged = i;
+            break;
+        }
     }
+    for(int i = 0; i < kheap_nr_holes; i++) {
+        kheap_hole_t* hole = &kheap_holes[i];
+        if(hole->start != end) continue;
+        if(merged < 0) {
+            hole->start = start;
+            hole->pgnum += pgnum;
+            return true;
+        }
+        // 左右两个空洞被这一段连成一个
+        kheap_holes[merged].pgnum += hole->pgnum;
+        *hole = kheap_holes[--kheap_nr_holes];
+        return true;
+    }
+    if(merged >= 0) return true;
+    if(kheap_nr_holes == KHEAP_MAX_HOLES) return false;
+    kheap_holes[kheap_nr_holes].start = start;
+    kheap_holes[kheap_nr_holes].pgnum = pgnum;
+    kheap_nr_holes++;
     return true;
+}
+
+/**
+ * @brief 堆顶回退到 top，紧挨着新堆顶的空洞一并收回
+ * 
+ */
+static void kheap_lower_top(uint64_t top) {
+    kheap_top = top;
+    for(int i = 0; i < kheap_nr_holes; i++) {
+        kheap_hole_t* hole = &kheap_holes[i];
+        if(hole->start + hole->pgnum * PAGE_SIZE != kheap_top) continue;
+        kheap_top = hole->start;
+        *hole = kheap_holes[--kheap_nr_holes];
+        i = -1;
+    }
+}
+
+/**
+ * @brief 把空闲块中完整的页解除映射：块头所在页之后（块头恰好页对齐时含块头页）到块尾最后一个完整页为止，
+ *        左右剩余部分各自保留为一个空闲块
+ * 
+ * @param hdr 空闲块
+ * @param tlb 待失效的地址与待释放的物理页记在这里
+ * @return size_t 解除映射的页数
+ */
+static size_t kheap_trim_block(kheap_pghdr_t* hdr, tlb_gather_t* tlb) {
+    uint64_t blk_start = (uint64_t)hdr;
+    uint64_t blk_end = blk_start + HEADER_SIZE + hdr->size;
+    uint64_t run_start = (blk_start & (PAGE_SIZE - 1)) ? ALIGN_UP(blk_start + HEADER_SIZE, PAGE_SIZE) : blk_start;
+    uint64_t run_end = ALIGN_DOWN(blk_end, PAGE_SIZE);
+    // 右侧剩余部分放不下块头时，少还一页
+    if(run_end < blk_end && blk_end - run_end < HEADER_SIZE) run_end -= PAGE_SIZE;
+    if(run_end <= run_start) return 0;
+    // 堆中间的页要记进空洞表，之后扩充时复用这段地址；记不下就不还，免得地址永久丢失
+    bool at_top = run_end == kheap_top;
+    if(!at_top && !kheap_hole_add(run_start, (run_end - run_start) / PAGE_SIZE)) return 0;
+
+    if(run_end < blk_end) {
+        kheap_pghdr_t* tail = (kheap_pghdr_t*)run_end;
+        tail->is_free = 1;
+        tail->size = blk_end - run_end - HEADER_SIZE;
+        list_add_after(&tail->node, &hdr->node);
+    }
+    if(run_start == blk_start) {
+        list_del(&hdr->node);
+    } else {
+        hdr->size = run_start - blk_start - HEADER_SIZE;
+    }
+
+    size_t n = vmm_unmap_range(kernel_pml4, run_start, (run_end - run_start) / PAGE_SIZE, tlb);
+    kheap_resident_pages -= n;
+    kheap_trimmed_pages += n;
+    // 堆顶的空闲页直接回退堆顶
+    if(at_top) kheap_lower_top(run_start);
+    return n;
+}
+
+/**
+ * @brief 在有序的堆块链表中找到地址 va 之后的第一个块，新块插在它之前
+ * 
+ */
+static list_node_t* kheap_block_after(uint64_t va) {
+    list_node_t* cur;
+    for(cur = kheap_list.next; cur != &kheap_list; cur = cur->next) {
+        if((uint64_t)cur > va) break;
+    }
+    return cur;
+}
+
+bool kheap_expand(size_t pgnum) {
+    // 先复用 kheap_trim 在堆中间留下的空洞，没有放得下的才从堆顶扩充
+    int hole = -1;
+    for(int i = 0; i < kheap_nr_holes; i++) {
+        if(kheap_holes[i].pgnum >= pgnum) {
+            hole = i;
+            break;
+        }
+    }
+    uint64_t va = hole >= 0 ? kheap_holes[hole].start : kheap_top;
+
+    // 堆页取自发起扩充的 CPU 所在节点，整段一次映射
+    size_t mapped = vmm_map_alloc(kernel_pml4, va, pgnum, PTE_KERNEL, pmm_alloc_page_node, numa_node_id());
+    if(mapped == 0) return false;
+    kheap_resident_pages += mapped;
+
+    // 设置空闲内核堆块内存头，整段作为一个块按地址顺序加入循环链表（从堆顶扩充时就是“末尾”）
+    kheap_pghdr_t* pghdr=(kheap_pghdr_t*) va;
+    pghdr->is_free=0;
+    pghdr->size = mapped*PAGE_SIZE-HEADER_SIZE;
+    list_add_before(&pghdr->node, hole >= 0 ? kheap_block_after(va) : &kheap_list);
+
+    // 与 kfree 相同的合并逻辑会把它和前后相邻的空闲块合并
+    kheap_free_block(pghdr);
+
+    // 更新空洞或堆顶指针
+    if(hole >= 0) {
+        kheap_holes[hole].start += mapped*PAGE_SIZE;
+        kheap_holes[hole].pgnum -= mapped;
+        if(kheap_holes[hole].pgnum == 0) kheap_holes[hole] = kheap_holes[--kheap_nr_holes];
+    } else {
+        kheap_top += mapped*PAGE_SIZE;
+    }
+    return mapped == pgnum;
 } 
 
 static kheap_pghdr_t* first_fit(size_t size) {
@@ -197,7 +1184,12 @@ static kheap_pghdr_t* first_fit(size_t size) {
 }
 
 
-void* kmalloc(size_t size) {
+static void* __kmalloc(size_t size) {
+    // 小对象走 slab，O(1) 且没有块头
+    if(size <= SLAB_MAX_SIZE) return slab_alloc(size);
+    // 大块走 vmalloc，一次走表映射整段，不在首次适配链表里留下空洞
+    if(size >= VMALLOC_MIN_SIZE) return vmalloc(size);
+
     size = ALIGN_UP(size,8);
 
     kheap_pghdr_t* target = first_fit(size);
@@ -209,7 +1201,7 @@ void* kmalloc(size_t size) {
         if(pg_needed == 0) pg_needed = 1;
         if(kheap_expand(pg_needed)) {
             // 扩充后重新分配
-            return kmalloc(size);
+            return __kmalloc(size);
         }
         return NULL;
     }
@@ -224,41 +1216,154 @@ void* kmalloc(size_t size) {
     }
 
     target->is_free = false;
+    kheap_used_bytes += target->size;
     return (void*)((uint64_t)target+HEADER_SIZE);
 } 
 
-void kfree(void* ptr) {
+static void __kfree(void* ptr) {
     if(!ptr) return;
+    if(slab_owns(ptr)) {
+        slab_free(ptr);
+        return;
+    }
+    if(vmalloc_owns(ptr)) {
+        vfree(ptr);
+        return;
+    }
     kheap_pghdr_t * hdr = (kheap_pghdr_t *) ((uint64_t)ptr-HEADER_SIZE);
-    hdr->is_free = 1;
-    list_node_t * next_node = hdr->node.next;
-    list_node_t * prev_node = hdr->node.prev;
+    if(hdr->is_free) {
+        kprintln("kfree: double free detected");
+        return;
+    }
+    kheap_used_bytes -= hdr->size;
+    hdr = kheap_free_block(hdr);
 
-    // 向后合并
-    if(next_node != &kheap_list) {
-        kheap_pghdr_t* next= (kheap_pghdr_t*) next_node;
-        if((uint64_t)hdr + hdr->size + HEADER_SIZE == (uint64_t)next) {
-            hdr->size += next->size + HEADER_SIZE;
-            list_del(next_node);
-        }
+    // 物理内存紧张时，把刚空出来的整页立即还给 PMM；只修剪合并后的这一块，不遍历整个堆
+    if(free_pages < KHEAP_TRIM_WATERMARK && hdr->size >= PAGE_SIZE) {
+        uint64_t flags = irq_save();
+        tlb_gather_t tlb;
+        tlb_gather_init(&tlb, kernel_pml4);
+        kheap_trim_block(hdr, &tlb);
+        tlb_gather_flush(&tlb);
+        irq_restore(flags);
     }
+}
 
-    // 向前合并
-    if(prev_node != &kheap_list) {
-        kheap_pghdr_t* prev=(kheap_pghdr_t*) prev_node;
-        if((uint64_t)prev + prev->size +HEADER_SIZE == (uint64_t)hdr) {
-            prev->size += hdr->size + HEADER_SIZE;
-            list_del(&hdr->node);
-        }
+/**
+ * @brief 吞并紧随其后的空闲块，使块至少有 size 字节
+ * 
+ * @param hdr 
+ * @param size 已按 8 字节对齐
+ * @return bool 
+ */
+static bool kheap_grow_block(kheap_pghdr_t* hdr, size_t size) {
+    list_node_t* next_node = hdr->node.next;
+    if(next_node == &kheap_list) return false;
+    kheap_pghdr_t* next = (kheap_pghdr_t*)next_node;
+    if(!next->is_free || (uint64_t)hdr + HEADER_SIZE + hdr->size != (uint64_t)next) return false;
+    size_t total = hdr->size + HEADER_SIZE + next->size;
+    if(total < size) return false;
+
+    size_t old_size = hdr->size;
+    list_del(next_node);
+    if(total >= size + HEADER_SIZE + MIN_SPLIT) {
+        kheap_pghdr_t* rest = (kheap_pghdr_t*)((uint64_t)hdr + HEADER_SIZE + size);
+        rest->is_free = 1;
+        rest->size = total - size - HEADER_SIZE;
+        list_add_after(&rest->node, &hdr->node);
+        hdr->size = size;
+    } else {
+        hdr->size = total;
+    }
+    kheap_used_bytes += hdr->size - old_size;
+    return true;
+}
+
+static void* __krealloc(void* ptr, size_t size) {
+    if(!ptr) return __kmalloc(size);
+    if(size == 0) {
+        __kfree(ptr);
+        return NULL;
+    }
+    // vmalloc 块原地补页或重映射，数据页不复制
+    if(vmalloc_owns(ptr)) return vrealloc(ptr, size);
+
+    size_t old_size;
+    if(slab_owns(ptr)) {
+        old_size = slab_size(ptr);
+        if(size <= old_size) return ptr;
+    } else {
+        kheap_pghdr_t* hdr = (kheap_pghdr_t*)((uint64_t)ptr - HEADER_SIZE);
+        old_size = hdr->size;
+        if(size <= old_size) return ptr;
+        // 后面紧跟的空闲块够用就原地增长
+        if(size < VMALLOC_MIN_SIZE && kheap_grow_block(hdr, ALIGN_UP(size, 8))) return ptr;
     }
 
+    void* new_ptr = __kmalloc(size);
+    if(!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    __kfree(ptr);
+    return new_ptr;
+}
+
+// 对外接口只在最外层记录调用点，内部互相调用不重复统计
+
+void* kmalloc(size_t size) {
+    void* ptr = __kmalloc(size);
+    if(kmprof_enabled && ptr) kmprof_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if(kmprof_enabled && ptr) kmprof_free(ptr);
+    __kfree(ptr);
+}
+
+void* krealloc(void* ptr, size_t size) {
+    void* new_ptr = __krealloc(ptr, size);
+    if(kmprof_enabled) {
+        // 失败时原块保持不变，仍算在原调用点上
+        if(ptr && (new_ptr || size == 0)) kmprof_free(ptr);
+        if(new_ptr) kmprof_alloc(new_ptr, size, __builtin_return_address(0));
+    }
+    return new_ptr;
+}
+
+size_t kheap_trim() {
+    size_t released = 0;
+    uint64_t flags = irq_save();
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, kernel_pml4);
+    list_node_t* cur = kheap_list.next;
+    while(cur != &kheap_list) {
+        kheap_pghdr_t* hdr = (kheap_pghdr_t*)cur;
+        cur = cur->next;
+        if(hdr->is_free) released += kheap_trim_block(hdr, &tlb);
+    }
+    // 所有段一起失效 TLB，再归还物理页
+    tlb_gather_flush(&tlb);
+    irq_restore(flags);
+
+    released += slab_shrink();
+    return released;
+}
+
+void kheap_dump_stats() {
+    size_t used_pages = ALIGN_UP(kheap_used_bytes, PAGE_SIZE) / PAGE_SIZE;
+    kprintf("Kernel heap: %ld pages resident, %ld bytes (~%ld pages) in use, %ld pages trimmed\n",
+        kheap_resident_pages, kheap_used_bytes, used_pages, kheap_trimmed_pages);
+    kprintf("vmalloc: %ld pages mapped\n", vmalloc_pages);
+    slab_dump_stats();
 }
 
 void kheap_init(size_t pgnum) {
     kprintln("Initing kernel heap memory manager...");
+    slab_init();
     list_init(&kheap_list);
     kheap_top = KERNEL_HEAP_BASE;
     kheap_expand(pgnum);
+    vmalloc_init();
     kprintf("kernel heap is setted at %lx - %lx !\n",KERNEL_HEAP_BASE,kheap_top);
 }
 
@@ -268,8 +1373,15 @@ void pmm_init(struct limine_memmap_response* mmap) {
 
     uintptr_t highest_pa = 0;
     // 获取物理内存最高地址
+    // 只统计 RAM 类型的条目，高地址的保留区 / 帧缓冲不需要 struct page
     for(uint64_t i=0;i<mmap->entry_count;i++) {
         struct limine_memmap_entry *e = mmap->entries[i];
+        if(e->type != LIMINE_MEMMAP_USABLE &&
+           e->type != LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE &&
+           e->type != LIMINE_MEMMAP_ACPI_RECLAIMABLE &&
+           e->type != LIMINE_MEMMAP_EXECUTABLE_AND_MODULES) {
+            continue;
+        }
         uintptr_t end = e->base + e->length;
         if(end > highest_pa) {
             highest_pa = end;
@@ -279,22 +1391,29 @@ void pmm_init(struct limine_memmap_response* mmap) {
 
     // 计算分页数以及bitmap大小
     total_pages = highest_pa/PAGE_SIZE;
-    bitmap_size = total_pages/8;
-    if(total_pages%8) bitmap_size++;
+    // 两级位图：叶子层每位一页，摘要层每位一个叶子字
+    bitmap_words = ALIGN_UP(total_pages, 64) / 64;
+    summary_words = ALIGN_UP(bitmap_words, 64) / 64;
+    bitmap_size = bitmap_words * sizeof(uint64_t);
     kprintf("Total pages num is %ld\n",total_pages);
-    kprintf("Bitmap size is %ld\n",bitmap_size);
+    kprintf("Bitmap size is %ld (summary %ld words)\n",bitmap_size,summary_words);
+
+    // 元数据 = bitmap + 摘要层 + struct page 数组，紧挨着存放
+    size_t mem_map_offset = ALIGN_UP(bitmap_size + summary_words * sizeof(uint64_t), 64);
+    size_t mem_map_size = total_pages * sizeof(page_t);
+    size_t meta_size = mem_map_offset + mem_map_size;
+    size_t meta_pages = ALIGN_UP(meta_size, PAGE_SIZE) / PAGE_SIZE;
 
     // 寻找区域存放bitmap
     uintptr_t bitmap_pa = 0;
     for(uint64_t i=0;i<mmap->entry_count;i++) {
         struct limine_memmap_entry *e = mmap->entries[i];
-        if(e->type == LIMINE_MEMMAP_USABLE && e->length >= bitmap_size) {
-            // 实际上，为了对齐安全，最好把 bitmap_size 向上对齐到 PAGE_SIZE 再扣除
+        if(e->type == LIMINE_MEMMAP_USABLE) {
+            // 实际上，为了对齐安全，最好把 meta_size 向上对齐到 PAGE_SIZE 再扣除
             // 这样保证剩下的内存也是页对齐的。
-            size_t bitmap_pages = ALIGN_UP(bitmap_size, PAGE_SIZE) / PAGE_SIZE;
-            size_t bitmap_reserved_size = bitmap_pages * PAGE_SIZE;
+            size_t meta_reserved_size = meta_pages * PAGE_SIZE;
             // 更新块信息
-            if (e->length >= bitmap_reserved_size) {
+            if (e->length >= meta_reserved_size) {
                 bitmap_pa = (uintptr_t)e->base;
                 break;
             }
@@ -309,12 +1428,19 @@ void pmm_init(struct limine_memmap_response* mmap) {
     kprintf("Bitmap is set PA at: %lx\n",bitmap_pa);
 
     // 利用 Limine HHDM 获取位图的虚拟地址
-    bitmap = (uint8_t*)(bitmap_pa + HHDM_OFFSET);
+    bitmap = (uint64_t*)(bitmap_pa + HHDM_OFFSET);
+    bitmap_summary = bitmap + bitmap_words;
 
     kprintf("Bitmap is set VA at: %lx\n",(uintptr_t)(bitmap));
 
-    // 初始化位图全为1
+    mem_map = (page_t*)((uintptr_t)bitmap + mem_map_offset);
+    memset(mem_map, 0, mem_map_size);
+    kprintf("struct page array at %lx: %ld bytes (%ld bytes per page)\n",
+            (uintptr_t)mem_map, mem_map_size, sizeof(page_t));
+
+    // 初始化位图全为1，摘要层全为0（没有任何空闲页）
     memset(bitmap,0xFF,bitmap_size);
+    memset(bitmap_summary,0,summary_words * sizeof(uint64_t));
 
     for(uint64_t i=0;i<mmap->entry_count;i++) {
         struct limine_memmap_entry *e = mmap->entries[i];
@@ -334,16 +1460,80 @@ void pmm_init(struct limine_memmap_response* mmap) {
     }
 
     // 【修复】：显式地将位图所在的物理页重新标记为占用
-    size_t bitmap_pages = ALIGN_UP(bitmap_size, PAGE_SIZE) / PAGE_SIZE;
-    pmm_set_busy(bitmap_pa, bitmap_pages);
-    kprintf("Reserved bitmap area: %lx (pages: %ld)\n", bitmap_pa, bitmap_pages);
+    pmm_set_busy(bitmap_pa, meta_pages);
+    kprintf("Reserved bitmap area: %lx (pages: %ld)\n", bitmap_pa, meta_pages);
     
     // 保护 0 号物理页 (NULL)
     // 防止 pmm_alloc 返回 0，导致空指针混淆
     pmm_set_busy(0, 1);
+
+    // 所有占用页（固件、内核、模块、元数据）标记为保留，put_page 对其无效
+    size_t pgidx = pmm_bitmap_find_busy(0);
+    while(pgidx < total_pages) {
+        size_t run_end = pmm_bitmap_find_free(pgidx);
+        for(size_t i = pgidx; i < run_end; i++) {
+            mem_map[i].flags = PG_reserved;
+            mem_map[i].refcount = 1;
+        }
+        pgidx = pmm_bitmap_find_busy(run_end);
+    }
+
+    // 根据 bitmap 中的空闲区间建立 buddy 空闲链表
+    // 相邻的 memmap 条目会被当作一个区间，拆出的块更大
+    for(int nid = 0; nid < MAX_NUMNODES; nid++) {
+        for(unsigned int order = 0; order < MAX_ORDER; order++) {
+            list_init(&pmm_nodes[nid].free_area[order]);
+            pmm_nodes[nid].free_area_count[order] = 0;
+        }
+        pmm_nodes[nid].free_pages = 0;
+    }
+
+    pgidx = pmm_bitmap_find_free(0);
+    while(pgidx < total_pages) {
+        size_t run_end = pmm_bitmap_find_busy(pgidx);
+        buddy_add_range(pgidx, run_end - pgidx);
+        pgidx = pmm_bitmap_find_free(run_end);
+    }
+
+    pmm_dump_stats();
     kprintln("===== Init pmm done!!! =====");
 }
 
+void pmm_numa_rebuild() {
+    uint64_t flags = irq_save();
+    zero_pool_drain();
+    pcp_drain_all();
+
+    for(int nid = 0; nid < MAX_NUMNODES; nid++) {
+        for(unsigned int order = 0; order < MAX_ORDER; order++) {
+            list_init(&pmm_nodes[nid].free_area[order]);
+            pmm_nodes[nid].free_area_count[order] = 0;
+        }
+        pmm_nodes[nid].free_pages = 0;
+    }
+    for(size_t i = 0; i < total_pages; i++) {
+        mem_map[i].flags &= ~PG_buddy;
+        mem_map[i].private = 0;
+    }
+
+    // 每段空闲区间在节点边界处切开，再拆成 buddy 块
+    size_t pgidx = pmm_bitmap_find_free(0);
+    while(pgidx < total_pages) {
+        size_t run_end = pmm_bitmap_find_busy(pgidx);
+        while(pgidx < run_end) {
+            int nid = pfn_to_nid(pgidx);
+            size_t seg_end = pgidx + 1;
+            while(seg_end < run_end && pfn_to_nid(seg_end) == nid) seg_end++;
+            buddy_add_range(pgidx, seg_end - pgidx);
+            pgidx = seg_end;
+        }
+        pgidx = pmm_bitmap_find_free(run_end);
+    }
+    irq_restore(flags);
+
+    pmm_dump_stats();
+}
+
 
 void* kstack_init(size_t size) {
     kprintln("Initing kernel stack ...");
@@ -356,17 +1546,15 @@ void* kstack_init(size_t size) {
     // 更新全局指针，为下一次分配做准备
     kstack_ptr = vaddr_top;
 
-    // 循环映射每一页
-    for (uint64_t v = vaddr_bottom; v < vaddr_top; v += PAGE_SIZE) {
-        uint64_t paddr = pmm_alloc_page();
-        if (paddr == 0) {
-            kprintln("Error: OOM during kstack allocation!");
-            return NULL;
-        }
-
-        vmm_map_page(kernel_pml4, v, paddr, PTE_PRESENT | PTE_RW);
+    // 一次取出整段连续物理页，再逐页映射
+    uint64_t paddr = pmm_alloc_contig(ALIGN_UP(size, PAGE_SIZE) / PAGE_SIZE, PAGE_SIZE);
+    if (paddr == 0) {
+        kprintln("Error: OOM during kstack allocation!");
+        return NULL;
     }
 
+    vmm_map_range(kernel_pml4, vaddr_bottom, paddr, ALIGN_UP(size, PAGE_SIZE), PTE_KERNEL);
+
     kprintf("kernel stack allocated: %lx - %lx\n", vaddr_bottom, vaddr_top);
     
     // 循环结束后再返回栈顶地址
@@ -384,16 +1572,11 @@ void kstack_free(uintptr_t kstack_base) {
     uintptr_t base = kstack_base;
     uintptr_t top = base + KSTACK_SIZE;
 
-    for(uintptr_t vaddr = base; vaddr < top ; vaddr += PAGE_SIZE)
-    {
-        pte_t* pte = vmm_get_pte(kernel_pml4, vaddr);
-        if(pte && (*pte & PTE_PRESENT)) {
-            uint64_t pa = PTE_GET_ADDR(*pte);
-            pmm_free_page(pa);
-            *pte = 0; // 解除映射
-            invlpg((void*) vaddr); // 刷新TLB
-        }
-    }
+    // 解除映射，统一失效 TLB 后再归还物理页
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, kernel_pml4);
+    vmm_unmap_range(kernel_pml4, base, (top - base) / PAGE_SIZE, &tlb);
+    tlb_gather_flush(&tlb);
 
     kprintf("Kernel stack freed: %lx - %lx\n", base, top);   
 }
\ No newline at end of file
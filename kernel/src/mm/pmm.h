@@ -6,6 +6,7 @@
 #include "../lib/string.h"
 #include "../lib/list.h"
 #include "paging.h"
+#include "numa.h"
 
 //****************************************** */
 //**                内核LAYOUT               */
@@ -43,49 +44,299 @@
 // 向下取整：x & ~4095
 #define ALIGN_DOWN(addr, align) ((addr) & ~((align) - 1))
 
-#define pa2pgidx(pa) (pa/PAGE_SIZE)
+#define pa2pgidx(pa) ((pa)/PAGE_SIZE)
 
 #define pgidx2pa(pgidx) ( (uint64_t)(pgidx)*PAGE_SIZE)
 
+//****************************************** */
+//**          物理页描述符 (struct page)      */
+//****************************************** */
+
+// 页标志
+#define PG_reserved (1u << 0)   // 不归 PMM 管理（固件、内核镜像、模块、PMM 元数据），永不释放
+#define PG_buddy    (1u << 1)   // 位于 buddy 空闲链表中的块首页，private 为块的阶
+#define PG_isolated (1u << 2)   // 内存规整期间已被目标窗口占下（空闲页摘出 buddy，或内容已迁走的用户页）
+#define PG_slab     (1u << 3)   // slab 页（经 HHDM 访问），private 为所属 slab 缓存的编号
+#define PG_anon     (1u << 4)   // 以 4KiB 表项映射的匿名用户页，内存规整时可迁移（透明大页、文件页不带）
+
+/**
+ * @brief 每个物理页框一个描述符，数组下标即 pa2pgidx(pa)
+ * 
+ */
+typedef struct page {
+    list_node_t list;   // 链表节点：空闲时挂在 buddy 空闲链表上
+    int32_t refcount;   // 引用计数，0 表示空闲；降为 0 时页框归还 PMM
+    union {
+        int32_t mapcount;   // 被多少个用户页表项映射
+        struct {
+            uint16_t inuse;     // PG_slab：已分配的对象数
+            uint16_t freelist;  // PG_slab：第一个空闲对象的页内偏移
+        } slab;
+    };
+    uint32_t flags;     // PG_* 标志
+    uint16_t private;   // 由 flags 决定含义（PG_buddy：块的阶，PG_slab：缓存编号）
+    uint16_t nid;       // 所属 NUMA 节点，numa_init 按 SRAT 填写一次，之后不变
+} page_t;
+
+// 元数据开销 32B / 4KiB < 1%
+_Static_assert(sizeof(page_t) <= 32, "struct page must stay within 32 bytes");
+
+// 物理页描述符数组，共 total_pages 项
+extern page_t* mem_map;
+
+static inline page_t* pa2page(uint64_t pa) {
+    return &mem_map[pa2pgidx(pa)];
+}
+
+static inline uint64_t page2pa(page_t* page) {
+    return pgidx2pa(page - mem_map);
+}
+
+/**
+ * @brief 物理页所属的节点，不在任何 SRAT 区间中的页归节点 0
+ * 
+ * @param pgidx 页号
+ * @return int 
+ */
+static inline int pfn_to_nid(size_t pgidx) {
+    return mem_map[pgidx].nid;
+}
+
+/**
+ * @brief 增加页的引用计数
+ * 
+ * @param page 
+ */
+void get_page(page_t* page);
+
+/**
+ * @brief 减少页的引用计数，降为 0 时归还 PMM（PG_reserved 页忽略）
+ * 
+ * @param page 
+ */
+void put_page(page_t* page);
+
 // hhdm偏移量
 extern uint64_t HHDM_OFFSET;
 
 // bitmap-pmm管理器
+// 两级位图：叶子层每位对应一页（1 = 占用），
+// 摘要层每位对应一个叶子字（1 = 该叶子字中还有空闲页），一个摘要字覆盖 64 个叶子字
 // 全局变量
-extern uint8_t* bitmap;             // 位图数组的虚拟地址
+extern uint64_t* bitmap;            // 位图数组的虚拟地址（叶子层）
+extern uint64_t* bitmap_summary;    // 摘要层
 extern size_t bitmap_size;          // 位图占用的字节数
 extern size_t total_pages;          // 物理内存总页数
 extern size_t free_pages;           // 当前空闲页数（统计用）
 
+// 位图查找统计：平均每次查找读取的字数 = bitmap_words_scanned / bitmap_lookups
+extern uint64_t bitmap_lookups;
+extern uint64_t bitmap_words_scanned;
+
 // 对bitmap的位操作
 extern bool bit_test(size_t bit);
 
-// 这是一个优化变量，下次分配时从这里开始扫描，避免每次都从头扫
-extern size_t last_free_index;
+/**
+ * @brief 查找 from 及之后的第一个空闲页（借助摘要层，tzcnt 定位）
+ * 
+ * @param from 起始页号
+ * @return size_t 页号，找不到返回 total_pages
+ */
+size_t pmm_bitmap_find_free(size_t from);
 
-// 初始化bitmap
+/**
+ * @brief 查找 from 及之后的第一个占用页（按 64 位字扫描）
+ * 
+ * @param from 起始页号
+ * @return size_t 页号，找不到返回 total_pages
+ */
+size_t pmm_bitmap_find_busy(size_t from);
+
+// buddy 伙伴系统
+// 阶 (order) 为 k 的块包含 2^k 个连续物理页，且按 2^k 页自然对齐
+// 最大块为 2^(MAX_ORDER-1) 页 = 4MiB
+#define MAX_ORDER 11
+// 2MiB 大页对应的阶与包含的 4KiB 页数
+#define HUGE_PAGE_ORDER 9
+#define HUGE_PAGE_NR (1UL << HUGE_PAGE_ORDER)
+
+/**
+ * @brief 每个 NUMA 节点一套 buddy 空闲链表与分配统计
+ *        位图仍是全局的，只记录页是否占用
+ * 
+ */
+typedef struct {
+    list_node_t free_area[MAX_ORDER];   // 各阶空闲块链表
+    size_t free_area_count[MAX_ORDER];  // 每一阶空闲链表中的块数（统计用）
+    size_t free_pages;                  // 本节点 buddy 中的空闲页数
+    uint64_t alloc_local;               // 请求本节点、也由本节点满足的分配页数
+    uint64_t alloc_fallback;            // 请求本节点、但由其他节点满足的分配页数
+} pmm_node_t;
+
+extern pmm_node_t pmm_nodes[MAX_NUMNODES];
+
+// 初始化bitmap与buddy空闲链表（此时所有页都在节点 0）
 void pmm_init(struct limine_memmap_response* mmap);
 
+/**
+ * @brief 清空各 CPU 页缓存与预清零池，按 pfn_to_nid 把 buddy 空闲块重新分配到各节点
+ * 
+ */
+void pmm_numa_rebuild();
+
+// 仅修改bitmap状态，用于初始化阶段（buddy 建立之前）
 void pmm_set_free(uintptr_t pa,size_t pgnum);
 void pmm_set_busy(uintptr_t pa,size_t pgnum);
 
 // 内存分配接口
 
 /**
- * @brief next_fit算法分配空闲物理页框
+ * @brief 计算容纳 size 字节所需的最小阶
+ * 
+ * @param size 字节数
+ * @return unsigned int 阶
+ */
+unsigned int get_order(size_t size);
+
+/**
+ * @brief buddy算法分配 2^order 个连续物理页框，起始地址按块大小自然对齐
+ *        块内每一页的引用计数都为 1，可以整块释放，也可以逐页 pmm_free_page
+ * 
+ * @param order 阶
+ * @return uint64_t 块起始物理地址，失败返回 0
+ */
+uint64_t pmm_alloc_pages(unsigned int order);
+
+/**
+ * @brief 优先从节点 nid 分配 2^order 个连续物理页框，本节点不足时退到其他节点
+ * 
+ * @param nid 
+ * @param order 
+ * @return uint64_t 
+ */
+uint64_t pmm_alloc_pages_node(int nid, unsigned int order);
+
+/**
+ * @brief 对块内每一页释放一次引用；全部降为 0 时整块归还并与空闲的伙伴块合并
+ * 
+ * @param pa 块起始物理地址
+ * @param order 分配时的阶
+ */
+void pmm_free_pages(uint64_t pa, unsigned int order);
+
+// 连续分配 / 内存规整统计
+extern uint64_t contig_allocs;          // pmm_alloc_contig 成功次数
+extern uint64_t contig_fallbacks;       // buddy 直接分配失败、转入窗口扫描的次数
+extern uint64_t compact_runs;           // 内存规整次数
+extern uint64_t compact_pages_migrated; // 规整迁移的用户页数
+extern uint64_t compact_failures;       // 规整后仍无法得到连续区间的次数
+
+/**
+ * @brief 分配 npages 个物理连续、起始地址按 align 对齐的页框
+ *        buddy 中没有合适的块时，扫描对齐窗口并迁移其中的用户页（内存规整）
+ *        每一页的引用计数都为 1，用 pmm_free_page 逐页释放
+ * 
+ * @param npages 页数
+ * @param align 对齐字节数，2 的幂，不足一页按一页
+ * @return uint64_t 起始物理地址，失败返回 0
+ */
+uint64_t pmm_alloc_contig(size_t npages, size_t align);
+
+/**
+ * @brief 碎片指数：空闲内存中无法组成 order 阶块的比例（千分比）
+ * 
+ * @param order 
+ * @return size_t 0 表示空闲页全在 >= order 阶的块里，1000 表示全部碎片化
+ */
+size_t pmm_frag_index(unsigned int order);
+
+/**
+ * @brief 打印物理内存统计：空闲页、buddy 各阶块数、位图平均扫描字数
+ * 
+ */
+void pmm_dump_stats();
+
+/**
+ * @brief 把 Bootloader / ACPI 可回收内存归还给 PMM
+ *        调用前必须已经不再访问 Limine 的响应、模块列表和引导页表
+ * 
+ * @param entries 启动时保存下来的 memmap 副本
+ * @param count 
+ * @return size_t 回收的页数
+ */
+size_t pmm_reclaim_boot_memory(const struct limine_memmap_entry* entries, size_t count);
+
+/**
+ * @brief 分配一个空闲物理页框（order 0），优先从本 CPU 的页缓存中取
  * 
  * @return uint64_t 
  */
 uint64_t pmm_alloc_page();
 
+/**
+ * @brief 优先从节点 nid 分配一个物理页框；nid 是本 CPU 的节点时走页缓存
+ * 
+ * @param nid 
+ * @return uint64_t 
+ */
+uint64_t pmm_alloc_page_node(int nid);
+
 
 /**
- * @brief 释放物理地址pa对应的物理页框
+ * @brief 释放物理地址pa对应页框的一次引用（put_page），
+ *        最后一个引用释放时页放入本 CPU 的 hot 缓存，优先被再次分配
  * 
  * @param pa 
  */
 void pmm_free_page(uint64_t pa);
 
+/**
+ * @brief 释放一个内容已不在 CPU cache 中的页（放入 cold 缓存，hot 用完后才分配）
+ * 
+ * @param pa 
+ */
+void pmm_free_page_cold(uint64_t pa);
+
+// 预清零页池命中 / 未命中次数
+extern uint64_t zero_pool_hits;
+extern uint64_t zero_pool_misses;
+
+/**
+ * @brief 分配一个内容全为 0 的物理页框，优先从预清零页池中取
+ * 
+ * @return uint64_t 失败返回 0
+ */
+uint64_t pmm_alloc_zeroed_page();
+
+/**
+ * @brief 优先从节点 nid 分配一个内容全为 0 的物理页框
+ * 
+ * @param nid 
+ * @return uint64_t 
+ */
+uint64_t pmm_alloc_zeroed_page_node(int nid);
+
+/**
+ * @brief 清零一页放入预清零页池，由 idle 进程在无事可做时调用
+ * 
+ * @return true 补充了一页
+ * @return false 池已满或空闲内存不足
+ */
+bool pmm_zero_pool_refill();
+
+/**
+ * @brief 把所有 CPU 页缓存中的页归还给 buddy
+ * 
+ */
+void pcp_drain_all();
+
+/**
+ * @brief 所有 CPU 页缓存中当前缓存的页数
+ * 
+ * @return size_t 
+ */
+size_t pcp_cached_pages();
+
 
 
 /**
@@ -102,12 +353,34 @@ typedef struct {
 #define HEADER_SIZE sizeof(kheap_pghdr_t)
 #define MIN_SPLIT 16
 
+// 空闲物理页低于该值时，kfree 空出整页后立即修剪刚释放的那一块
+#define KHEAP_TRIM_WATERMARK 1024
+
+// 堆内存统计：常驻页数（已映射）与已分配字节数
+extern size_t kheap_resident_pages;
+extern size_t kheap_used_bytes;
+extern uint64_t kheap_trimmed_pages;
+
 bool kheap_expand(size_t pgnum);
 
+/**
+ * @brief 修剪内核堆：解除空闲块中完整页的映射并归还 PMM（堆中间的地址记入空洞表留待扩充时复用），同时释放 slab 缓存保留的空页
+ * 
+ * @return size_t 归还的页数
+ */
+size_t kheap_trim();
+
+/**
+ * @brief 打印堆常驻页数与使用量，以及各 slab 缓存的统计
+ * 
+ */
+void kheap_dump_stats();
+
 void kheap_init(size_t init_pages);
 
 /**
- * @brief 首次适配算法分配内核堆内存块
+ * @brief 分配内核内存：不超过 SLAB_MAX_SIZE 的请求由 slab 尺寸类满足，
+ *        不小于 VMALLOC_MIN_SIZE 的请求走 vmalloc，其余用首次适配算法分配内核堆内存块
  * @param size 内存块大小
  * @return void* 内存块指针
  */
@@ -115,6 +388,15 @@ void* kmalloc(size_t size);
 
 void kfree(void* ptr);
 
+/**
+ * @brief 调整 kmalloc 内存块的大小：能原地增长就不移动；
+ *        vmalloc 块在原地补页或把已有物理页重映射到新地址，不复制数据
+ * @param ptr 为 NULL 时等同 kmalloc
+ * @param size 为 0 时等同 kfree
+ * @return void* 失败返回 NULL，原内存块保持不变
+ */
+void* krealloc(void* ptr, size_t size);
+
 //************************************************** */
 //*************        kstack             ********** */
 //************************************************** */
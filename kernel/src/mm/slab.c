@@ -0,0 +1,251 @@
+#include "slab.h"
+#include "pmm.h"
+#include "../arch/x86_64.h"
+#include "../drivers/console.h"
+
+// 空闲链表结束标记（页内偏移不可能取到）
+#define SLAB_FREELIST_END 0xFFFF
+
+// 前 KMALLOC_CACHES 个是 kmalloc 尺寸类，之后是 kmem_cache_create 创建的缓存
+static kmem_cache_t slab_caches[SLAB_MAX_CACHES];
+static unsigned int nr_caches = 0;
+
+static const char* kmalloc_names[KMALLOC_CACHES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1k", "kmalloc-2k",
+};
+
+/**
+ * @brief 请求大小对应的尺寸类编号
+ * 
+ * @param size 
+ * @return unsigned int 
+ */
+static inline unsigned int size_to_class(size_t size) {
+    if(size <= SLAB_MIN_SIZE) return 0;
+    return 64 - __builtin_clzll(size - 1) - SLAB_MIN_SHIFT;
+}
+
+static inline uint8_t* slab_base(page_t* page) {
+    return (uint8_t*)(page2pa(page) + HHDM_OFFSET);
+}
+
+static inline uint16_t* obj_link(kmem_cache_t* cache, uint8_t* obj) {
+    return (uint16_t*)(obj + cache->link);
+}
+
+/**
+ * @brief 为缓存新分配一个 slab 页，构造所有对象并串成空闲链表
+ * 
+ * @param cache 
+ * @return true 
+ * @return false 
+ */
+static bool cache_grow(kmem_cache_t* cache) {
+    uint64_t pa = pmm_alloc_page();
+    if(pa == 0) return false;
+
+    page_t* page = pa2page(pa);
+    page->flags |= PG_slab;
+    page->private = cache - slab_caches;
+    page->slab.inuse = 0;
+    page->slab.freelist = 0;
+
+    uint8_t* base = slab_base(page);
+    for(size_t i = 0; i < cache->objs_per_slab; i++) {
+        uint8_t* obj = base + i * cache->stride;
+        if(cache->ctor) cache->ctor(obj);
+        *obj_link(cache, obj) = (i + 1 < cache->objs_per_slab) ? (i + 1) * cache->stride : SLAB_FREELIST_END;
+    }
+
+    list_add_after(&page->list, &cache->partial);
+    cache->nr_slabs++;
+    cache->nr_empty++;
+    return true;
+}
+
+/**
+ * @brief 初始化一个缓存描述符
+ * 
+ * @param cache 
+ * @param name 
+ * @param size 
+ * @param align 
+ * @param ctor 
+ * @return true 
+ * @return false 对象放不进一页
+ */
+static bool cache_setup(kmem_cache_t* cache, const char* name, size_t size, size_t align, void (*ctor)(void*)) {
+    if(align == 0) align = 8;
+    if(size < sizeof(uint16_t)) size = sizeof(uint16_t);
+    cache->name = name;
+    cache->size = size;
+    cache->ctor = ctor;
+    cache->link = ctor ? size : 0;
+    cache->stride = ALIGN_UP(cache->link + (ctor ? sizeof(uint16_t) : size), align);
+    if(cache->stride > PAGE_SIZE) return false;
+    cache->objs_per_slab = PAGE_SIZE / cache->stride;
+    list_init(&cache->partial);
+    cache->nr_slabs = 0;
+    cache->nr_active = 0;
+    cache->nr_empty = 0;
+    return true;
+}
+
+void slab_init() {
+    for(unsigned int i = 0; i < KMALLOC_CACHES; i++) {
+        cache_setup(&slab_caches[i], kmalloc_names[i], SLAB_MIN_SIZE << i, SLAB_MIN_SIZE << i, NULL);
+    }
+    nr_caches = KMALLOC_CACHES;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, void (*ctor)(void*)) {
+    if(align & (align - 1)) {
+        kprintf("kmem_cache_create(%s): align %ld is not a power of two\n", name, align);
+        return NULL;
+    }
+    if(nr_caches == SLAB_MAX_CACHES) {
+        kprintf("kmem_cache_create(%s): too many caches\n", name);
+        return NULL;
+    }
+    kmem_cache_t* cache = &slab_caches[nr_caches];
+    if(!cache_setup(cache, name, size, align, ctor)) {
+        kprintf("kmem_cache_create(%s): object size %ld too large\n", name, size);
+        return NULL;
+    }
+    nr_caches++;
+    return cache;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint64_t flags = irq_save();
+    if(cache->partial.next == &cache->partial && !cache_grow(cache)) {
+        irq_restore(flags);
+        return NULL;
+    }
+
+    page_t* page = container_of(cache->partial.next, page_t, list);
+    uint8_t* obj = slab_base(page) + page->slab.freelist;
+    page->slab.freelist = *obj_link(cache, obj);
+    if(page->slab.inuse++ == 0) cache->nr_empty--;
+    // 最后一个对象分配出去后，slab 页离开 partial 链表
+    if(page->slab.freelist == SLAB_FREELIST_END) list_del(&page->list);
+    cache->nr_active++;
+    irq_restore(flags);
+    return obj;
+}
+
+/**
+ * @brief 把对象放回 slab 页的空闲链表；页全空且缓存已有足够空页时归还 PMM
+ * 
+ * @param cache 
+ * @param page 
+ * @param obj 
+ */
+static void cache_free(kmem_cache_t* cache, page_t* page, uint8_t* obj) {
+    uint16_t off = obj - slab_base(page);
+    if(off % cache->stride || page->slab.inuse == 0) {
+        kprintf("slab: bad free of %lx in %s\n", (uint64_t)obj, cache->name);
+        return;
+    }
+
+    uint64_t flags = irq_save();
+    bool was_full = page->slab.freelist == SLAB_FREELIST_END;
+    *obj_link(cache, obj) = page->slab.freelist;
+    page->slab.freelist = off;
+    cache->nr_active--;
+    if(was_full) list_add_after(&page->list, &cache->partial);
+
+    if(--page->slab.inuse == 0) {
+        cache->nr_empty++;
+        // 保留少量空 slab 应对反复分配释放，其余归还 PMM
+        if(cache->nr_empty > SLAB_KEEP_EMPTY) {
+            list_del(&page->list);
+            page->flags &= ~PG_slab;
+            page->private = 0;
+            page->mapcount = 0;
+            cache->nr_empty--;
+            cache->nr_slabs--;
+            pmm_free_page(page2pa(page));
+        }
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief 对象所在的 slab 页，不是 slab 对象时返回 NULL
+ * 
+ * @param ptr 
+ * @return page_t* 
+ */
+static page_t* obj_to_page(const void* ptr) {
+    page_t* page = pa2page((uint64_t)ptr - HHDM_OFFSET);
+    if(!(page->flags & PG_slab) || page->private >= nr_caches) return NULL;
+    return page;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if(obj == NULL) return;
+    page_t* page = slab_owns(obj) ? obj_to_page(obj) : NULL;
+    if(page == NULL || &slab_caches[page->private] != cache) {
+        kprintf("kmem_cache_free(%s): %lx does not belong to this cache\n", cache->name, (uint64_t)obj);
+        return;
+    }
+    cache_free(cache, page, obj);
+}
+
+void* slab_alloc(size_t size) {
+    return kmem_cache_alloc(&slab_caches[size_to_class(size)]);
+}
+
+bool slab_owns(const void* ptr) {
+    uint64_t va = (uint64_t)ptr;
+    return va >= HHDM_OFFSET && va < HHDM_OFFSET + total_pages * PAGE_SIZE;
+}
+
+size_t slab_size(const void* ptr) {
+    page_t* page = obj_to_page(ptr);
+    return page ? slab_caches[page->private].size : 0;
+}
+
+void slab_free(void* ptr) {
+    page_t* page = obj_to_page(ptr);
+    if(page == NULL) {
+        kprintf("kfree: %lx is not a slab object\n", (uint64_t)ptr);
+        return;
+    }
+    cache_free(&slab_caches[page->private], page, ptr);
+}
+
+size_t slab_shrink() {
+    size_t released = 0;
+    uint64_t flags = irq_save();
+    for(unsigned int i = 0; i < nr_caches; i++) {
+        kmem_cache_t* cache = &slab_caches[i];
+        list_node_t* node = cache->partial.next;
+        while(node != &cache->partial && cache->nr_empty) {
+            page_t* page = container_of(node, page_t, list);
+            node = node->next;
+            if(page->slab.inuse) continue;
+            list_del(&page->list);
+            page->flags &= ~PG_slab;
+            page->private = 0;
+            page->mapcount = 0;
+            cache->nr_empty--;
+            cache->nr_slabs--;
+            pmm_free_page(page2pa(page));
+            released++;
+        }
+    }
+    irq_restore(flags);
+    return released;
+}
+
+void slab_dump_stats() {
+    kprintln("Slab caches (object size: active / total objects, slab pages):");
+    for(unsigned int i = 0; i < nr_caches; i++) {
+        kmem_cache_t* cache = &slab_caches[i];
+        kprintf("  %s (%ld B): %ld / %ld, %ld pages\n", cache->name, cache->size, cache->nr_active,
+            cache->nr_slabs * cache->objs_per_slab, cache->nr_slabs);
+    }
+}
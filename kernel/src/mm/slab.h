@@ -0,0 +1,119 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../lib/list.h"
+
+// kmalloc 的 slab 尺寸类：16B, 32B, ... 2KiB，更大的请求走页粒度的首次适配堆
+#define SLAB_MIN_SHIFT 4
+#define SLAB_MAX_SHIFT 11
+#define SLAB_MIN_SIZE (1UL << SLAB_MIN_SHIFT)
+#define SLAB_MAX_SIZE (1UL << SLAB_MAX_SHIFT)
+#define KMALLOC_CACHES (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+
+// 缓存总数上限（含 kmalloc 尺寸类），缓存编号记录在 slab 页的 struct page 中
+#define SLAB_MAX_CACHES 32
+
+// 每个缓存最多保留的全空 slab 页数，多出来的还给 PMM
+#define SLAB_KEEP_EMPTY 1
+
+// 缓存行大小，频繁访问的对象按缓存行对齐，避免两个对象共用一行
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief 一种固定大小对象的缓存
+ *        slab 页经 HHDM 访问，元数据全部放在页的 struct page 中：
+ *        page->list 挂在 partial 链表上，page->slab 记录已分配数与空闲链表头，
+ *        空闲对象在 link 偏移处存下一个空闲对象的页内偏移
+ * 
+ */
+typedef struct {
+    const char* name;
+    size_t size;            // 对象大小
+    size_t stride;          // 相邻对象的间距（按对齐要求向上取整）
+    size_t link;            // 空闲链接在对象内的偏移；有构造函数时放在对象之后，不破坏已构造的内容
+    size_t objs_per_slab;   // 每个 slab 页的对象数
+    void (*ctor)(void*);    // 新 slab 页中每个对象调用一次；释放回缓存的对象应保持构造后的状态
+    list_node_t partial;    // 还有空闲对象的 slab 页（含全空的）
+    size_t nr_slabs;        // slab 页数
+    size_t nr_active;       // 已分配的对象数
+    size_t nr_empty;        // 全空的 slab 页数
+} kmem_cache_t;
+
+/**
+ * @brief 初始化 kmalloc 尺寸类缓存
+ * 
+ */
+void slab_init();
+
+/**
+ * @brief 创建一个固定大小对象的缓存
+ * 
+ * @param name 缓存名（只保存指针）
+ * @param size 对象大小，加上对齐后不超过一页
+ * @param align 对齐字节数，2 的幂，0 表示按 8 字节对齐；传 CACHE_LINE_SIZE 得到缓存行对齐
+ * @param ctor 可选的构造函数
+ * @return kmem_cache_t* 失败返回 NULL
+ */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, void (*ctor)(void*));
+
+/**
+ * @brief 从缓存中分配一个对象，O(1)
+ * 
+ * @param cache 
+ * @return void* 
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/**
+ * @brief 把对象还给所属缓存，O(1)
+ * 
+ * @param cache 
+ * @param obj 
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/**
+ * @brief 从对应尺寸类分配对象，O(1)
+ * 
+ * @param size 不超过 SLAB_MAX_SIZE
+ * @return void* 
+ */
+void* slab_alloc(size_t size);
+
+/**
+ * @brief 指针是否指向 slab 页（位于 HHDM 中）
+ * 
+ * @param ptr 
+ * @return true 
+ * @return false 
+ */
+bool slab_owns(const void* ptr);
+
+/**
+ * @brief slab 对象的可用大小（所属缓存的对象大小）
+ * 
+ * @param ptr 
+ * @return size_t 
+ */
+size_t slab_size(const void* ptr);
+
+/**
+ * @brief 释放 slab 对象，O(1)；所属缓存从所在页的 struct page 得到
+ * 
+ * @param ptr 
+ */
+void slab_free(void* ptr);
+
+/**
+ * @brief 把所有缓存中全空的 slab 页还给 PMM
+ * 
+ * @return size_t 归还的页数
+ */
+size_t slab_shrink();
+
+/**
+ * @brief 打印各缓存的活跃对象数、总对象数与 slab 页数
+ * 
+ */
+void slab_dump_stats();
@@ -0,0 +1,327 @@
+#include "vmalloc.h"
+#include "slab.h"
+#include "../arch/x86_64.h"
+#include "../drivers/console.h"
+
+extern pg_table_t* kernel_pml4;
+
+static list_node_t vmap_list;           // 已分配区间，按起始地址排序
+static rb_root_t vmap_root;             // 同一批区间的红黑树，带最大间隙增强
+static kmem_cache_t* vmap_cache = NULL;
+size_t vmalloc_pages = 0;
+
+/**
+ * @brief 为 [va, va + npages 页) 分配物理页并映射，物理页不要求连续
+ *
+ * @return size_t 成功映射的页数
+ */
+static size_t vmap_pages(uint64_t va, size_t npages) {
+    return vmm_map_alloc(kernel_pml4, va, npages, PTE_KERNEL, pmm_alloc_page_node, numa_node_id());
+}
+
+/**
+ * @brief 解除 [va, va + npages 页) 的映射并释放物理页
+ *
+ */
+static void vunmap_pages(uint64_t va, size_t npages) {
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, kernel_pml4);
+    vmm_unmap_range(kernel_pml4, va, npages, &tlb);
+    tlb_gather_flush(&tlb);
+}
+
+/**
+ * @brief 把 [src, src + npages 页) 的页表项搬到 dst，物理页不动
+ *
+ * @return bool 目标页表分配失败时返回 false，已搬的项会搬回去
+ */
+static bool vmove_pages(uint64_t dst, uint64_t src, size_t npages) {
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, kernel_pml4);
+    for(size_t i = 0; i < npages; i++) {
+        uint64_t s = src + i * PAGE_SIZE;
+        uint64_t d = dst + i * PAGE_SIZE;
+        pg_table_t* spt = vmm_get_pt(kernel_pml4, s, false, 0);
+        pg_table_t* dpt = vmm_get_pt(kernel_pml4, d, true, PTE_KERNEL);
+        if(dpt == NULL) {
+            tlb_gather_flush(&tlb);
+            vmove_pages(src, dst, i);
+            return false;
+        }
+        dpt->entries[PT_IDX(d)] = spt->entries[PT_IDX(s)];
+        spt->entries[PT_IDX(s)] = 0;
+        // 只记地址不释放物理页，搬完后统一失效旧地址
+        tlb_gather_add(&tlb, s, 0);
+    }
+    tlb_gather_flush(&tlb);
+    return true;
+}
+
+/**
+ * @brief 区间占用的地址范围结尾（含保护页）
+ *
+ */
+static inline uint64_t vmap_end(vmap_area_t* area) {
+    return area->start + (area->nr_pages + 1) * PAGE_SIZE;
+}
+
+/**
+ * @brief area 之前的空闲间隙：从前一个区间的保护页之后（没有则为 VMALLOC_START）到 area->start
+ *
+ */
+static uint64_t vmap_gap(vmap_area_t* area) {
+    uint64_t prev_end = VMALLOC_START;
+    if(area->node.prev != &vmap_list) prev_end = vmap_end((vmap_area_t*)area->node.prev);
+    return area->start - prev_end;
+}
+
+/**
+ * @brief 红黑树的增强回调：子树中最大的间隙 = max(自身之前的间隙, 左右子树的最大间隙)
+ *
+ */
+static void vmap_augment(rb_node_t* node) {
+    vmap_area_t* area = rb_entry(node, vmap_area_t, rb_node);
+    uint64_t gap = vmap_gap(area);
+    if(node->left) {
+        uint64_t left = rb_entry(node->left, vmap_area_t, rb_node)->rb_subtree_gap;
+        if(left > gap) gap = left;
+    }
+    if(node->right) {
+        uint64_t right = rb_entry(node->right, vmap_area_t, rb_node)->rb_subtree_gap;
+        if(right > gap) gap = right;
+    }
+    area->rb_subtree_gap = gap;
+}
+
+static vmap_area_t* vmap_next(vmap_area_t* area) {
+    if(area->node.next == &vmap_list) return NULL;
+    return (vmap_area_t*)area->node.next;
+}
+
+/**
+ * @brief area 之前的间隙变了（前一个区间的大小或自身的起点变化），更新到根
+ *
+ */
+static void vmap_gap_update(vmap_area_t* area) {
+    if(area) rb_propagate(&vmap_root, &area->rb_node);
+}
+
+/**
+ * @brief 把 area 按起始地址插入红黑树和有序链表，调用者保证不与已有的区间重叠
+ *
+ */
+static void vmap_link(vmap_area_t* area) {
+    rb_node_t** link = &vmap_root.root;
+    rb_node_t* parent = NULL;
+    vmap_area_t* prev = NULL;
+    while(*link) {
+        parent = *link;
+        vmap_area_t* cur = rb_entry(parent, vmap_area_t, rb_node);
+        if(area->start < cur->start) {
+            link = &parent->left;
+        } else {
+            prev = cur;
+            link = &parent->right;
+        }
+    }
+    // 链表与树同序，先挂链表，增强回调计算间隙时要用到前一个区间
+    list_add_after(&area->node, prev ? &prev->node : &vmap_list);
+    rb_link_node(&area->rb_node, parent, link);
+    rb_insert_color(&vmap_root, &area->rb_node);
+    // 后一个区间之前的间隙被 area 占掉了一部分
+    vmap_gap_update(vmap_next(area));
+}
+
+/**
+ * @brief 把 area 从红黑树和链表中摘下，不释放
+ *
+ */
+static void vmap_unlink(vmap_area_t* area) {
+    vmap_area_t* next = vmap_next(area);
+    list_del(&area->node);
+    rb_erase(&vmap_root, &area->rb_node);
+    vmap_gap_update(next);
+}
+
+/**
+ * @brief 在 node 的子树中找地址最低、之前的间隙能放下 span 字节的区间，靠最大间隙剪枝
+ *
+ * @return uint64_t 间隙起始地址，找不到返回 0
+ */
+static uint64_t vmap_find_gap_lowest(rb_node_t* node, uint64_t span) {
+    if(node == NULL) return 0;
+    vmap_area_t* area = rb_entry(node, vmap_area_t, rb_node);
+    if(area->rb_subtree_gap < span) return 0;
+    // 左子树地址更低，先找
+    uint64_t addr = vmap_find_gap_lowest(node->left, span);
+    if(addr) return addr;
+    uint64_t gap = vmap_gap(area);
+    if(gap >= span) return area->start - gap;
+    return vmap_find_gap_lowest(node->right, span);
+}
+
+/**
+ * @brief 首次适配找一段空闲虚拟地址，区间之后留一页保护页
+ *
+ * @param npages 需要映射的页数
+ * @return uint64_t 失败返回 0
+ */
+static uint64_t vmap_find_gap(size_t npages) {
+    uint64_t span = (npages + 1) * PAGE_SIZE;
+    uint64_t addr = vmap_find_gap_lowest(vmap_root.root, span);
+    if(addr) return addr;
+    // 最后一个区间之后到 VMALLOC_END 的空间不属于任何区间之前的间隙，单独检查
+    uint64_t top = VMALLOC_START;
+    if(vmap_list.prev != &vmap_list) top = vmap_end((vmap_area_t*)vmap_list.prev);
+    return VMALLOC_END - top >= span ? top : 0;
+}
+
+static vmap_area_t* vmap_find(uint64_t va) {
+    rb_node_t* node = vmap_root.root;
+    while(node) {
+        vmap_area_t* area = rb_entry(node, vmap_area_t, rb_node);
+        if(va < area->start) {
+            node = node->left;
+        } else if(va > area->start) {
+            node = node->right;
+        } else {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 区间之后到下一个区间（或 vmalloc 区末尾）之间可用的地址上界
+ *
+ */
+static uint64_t vmap_limit(vmap_area_t* area) {
+    if(area->node.next == &vmap_list) return VMALLOC_END;
+    return ((vmap_area_t*)area->node.next)->start;
+}
+
+void vmalloc_init() {
+    list_init(&vmap_list);
+    vmap_root.root = NULL;
+    vmap_root.augment = vmap_augment;
+    vmap_cache = kmem_cache_create("vmap_area_t", sizeof(vmap_area_t), 0, NULL);
+    // 预先建好 vmalloc 区的 PDPT，内核 PML4 的这一项此后不再变化
+    if(get_next_table(kernel_pml4, PML4_IDX(VMALLOC_START), true, PTE_PRESENT | PTE_RW) == NULL) {
+        kprintln("Panic: failed to set up vmalloc area!");
+    }
+}
+
+void* vmalloc(size_t size) {
+    if(size == 0 || vmap_cache == NULL) return NULL;
+    size_t npages = ALIGN_UP(size, PAGE_SIZE) / PAGE_SIZE;
+
+    vmap_area_t* area = kmem_cache_alloc(vmap_cache);
+    if(area == NULL) return NULL;
+
+    uint64_t flags = irq_save();
+    uint64_t va = vmap_find_gap(npages);
+    if(va == 0) {
+        irq_restore(flags);
+        kmem_cache_free(vmap_cache, area);
+        return NULL;
+    }
+    area->start = va;
+    area->nr_pages = npages;
+    vmap_link(area);
+
+    if(vmap_pages(va, npages) != npages) {
+        vunmap_pages(va, npages);
+        vmap_unlink(area);
+        irq_restore(flags);
+        kmem_cache_free(vmap_cache, area);
+        return NULL;
+    }
+    vmalloc_pages += npages;
+    irq_restore(flags);
+    return (void*)va;
+}
+
+void vfree(void* ptr) {
+    if(ptr == NULL) return;
+    uint64_t flags = irq_save();
+    vmap_area_t* area = vmap_find((uint64_t)ptr);
+    if(area == NULL) {
+        irq_restore(flags);
+        kprintf("vfree: %lx is not a vmalloc area\n", (uint64_t)ptr);
+        return;
+    }
+    vunmap_pages(area->start, area->nr_pages);
+    vmalloc_pages -= area->nr_pages;
+    vmap_unlink(area);
+    irq_restore(flags);
+    kmem_cache_free(vmap_cache, area);
+}
+
+void* vrealloc(void* ptr, size_t size) {
+    if(ptr == NULL) return vmalloc(size);
+    if(size == 0) {
+        vfree(ptr);
+        return NULL;
+    }
+    size_t npages = ALIGN_UP(size, PAGE_SIZE) / PAGE_SIZE;
+
+    uint64_t flags = irq_save();
+    vmap_area_t* area = vmap_find((uint64_t)ptr);
+    if(area == NULL) {
+        irq_restore(flags);
+        kprintf("vrealloc: %lx is not a vmalloc area\n", (uint64_t)ptr);
+        return NULL;
+    }
+
+    // 缩小：归还尾部的页
+    if(npages <= area->nr_pages) {
+        vunmap_pages(area->start + npages * PAGE_SIZE, area->nr_pages - npages);
+        vmalloc_pages -= area->nr_pages - npages;
+        area->nr_pages = npages;
+        vmap_gap_update(vmap_next(area));
+        irq_restore(flags);
+        return ptr;
+    }
+
+    size_t extra = npages - area->nr_pages;
+    uint64_t old_end = area->start + area->nr_pages * PAGE_SIZE;
+
+    // 原地增长：后面的地址足够放下新增的页和保护页
+    if(area->start + (npages + 1) * PAGE_SIZE <= vmap_limit(area)) {
+        if(vmap_pages(old_end, extra) != extra) {
+            vunmap_pages(old_end, extra);
+            irq_restore(flags);
+            return NULL;
+        }
+        area->nr_pages = npages;
+        vmap_gap_update(vmap_next(area));
+        vmalloc_pages += extra;
+        irq_restore(flags);
+        return ptr;
+    }
+
+    // 换一段地址：已有的页只搬页表项，之后补上新增的页
+    uint64_t va = vmap_find_gap(npages);
+    if(va == 0 || vmap_pages(va + area->nr_pages * PAGE_SIZE, extra) != extra) {
+        if(va) vunmap_pages(va + area->nr_pages * PAGE_SIZE, extra);
+        irq_restore(flags);
+        return NULL;
+    }
+    if(!vmove_pages(va, area->start, area->nr_pages)) {
+        vunmap_pages(va + area->nr_pages * PAGE_SIZE, extra);
+        irq_restore(flags);
+        return NULL;
+    }
+    vmap_unlink(area);
+    area->start = va;
+    area->nr_pages = npages;
+    vmap_link(area);
+    vmalloc_pages += extra;
+    irq_restore(flags);
+    return (void*)va;
+}
+
+bool vmalloc_owns(const void* ptr) {
+    uint64_t va = (uint64_t)ptr;
+    return va >= VMALLOC_START && va < VMALLOC_END;
+}
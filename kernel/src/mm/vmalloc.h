@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../lib/list.h"
+#include "../lib/rbtree.h"
+#include "pmm.h"
+
+// vmalloc 区取 KERNEL_MMIO_BASE 开始的一个 PML4 表项（512GiB）
+// 对应的 PDPT 在 vmalloc_init 中预先建好，之后创建的进程复制内核高半部分时就能看到
+#define VMALLOC_START KERNEL_MMIO_BASE
+#define VMALLOC_END   (KERNEL_MMIO_BASE + (1UL << 39))
+
+// kmalloc 中不小于该值的请求直接走 vmalloc，不再扩充首次适配堆
+#define VMALLOC_MIN_SIZE (4 * PAGE_SIZE)
+
+/**
+ * @brief 一段 vmalloc 虚拟地址区间，其后紧跟一页不映射的保护页
+ *
+ */
+typedef struct {
+    list_node_t node;           // 按起始地址排序挂在 vmap_list 上
+    rb_node_t rb_node;          // 按起始地址挂在红黑树上，查找与找空闲区间都是 O(log n)
+    uint64_t rb_subtree_gap;    // 子树中各区间之前最大的空闲间隙，找空闲区间时据此剪枝
+    uint64_t start;             // 起始虚拟地址
+    size_t nr_pages;            // 已映射的页数（不含保护页）
+} vmap_area_t;
+
+extern size_t vmalloc_pages;    // vmalloc 区当前映射的页数
+
+void vmalloc_init();
+
+/**
+ * @brief 分配虚拟连续、物理不连续的内核内存，按页取整
+ *
+ * @param size
+ * @return void* 失败返回 NULL
+ */
+void* vmalloc(size_t size);
+
+/**
+ * @brief 释放 vmalloc 分配的内存
+ *
+ * @param ptr
+ */
+void vfree(void* ptr);
+
+/**
+ * @brief 调整 vmalloc 块的大小：缩小时归还尾部页；
+ *        增大时后面的地址空闲就原地补页，否则把已有的物理页重映射到新区间，不复制数据
+ *
+ * @param ptr
+ * @param size
+ * @return void* 失败返回 NULL，原块保持不变
+ */
+void* vrealloc(void* ptr, size_t size);
+
+bool vmalloc_owns(const void* ptr);
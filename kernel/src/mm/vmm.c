@@ -1,20 +1,57 @@
 #include "vmm.h"
+#include "../proc/proc.h"
+#include "slab.h"
+#include "../arch/x86_64.h"
+#include "../fs/ramfs.h"
+
+// mm_struct 每次创建进程都要分配，按缓存行对齐；VMA 数量多、体积小，按默认对齐紧凑存放
+static kmem_cache_t* mm_cache = NULL;
+static kmem_cache_t* vma_cache = NULL;
+
+// asid 按代分配：一代内依次分出 1..MM_NR_ASIDS-1，用完后进入下一代，
+// 所有 mm 的 asid 随之过期，下次加载时重新分配并刷新
+static uint64_t asid_generation = 1;
+static uint16_t next_asid = 1;
+
+int thp_policy = THP_ALWAYS;
+static uint64_t nr_thp_alloc = 0;       // 用 2MiB 页映射的次数
+static uint64_t nr_thp_fallback = 0;    // 本可以用大页、但分配或映射失败退回小页的次数
+static uint64_t nr_small_mapped = 0;    // 用 4KiB 页映射的用户页数
+static uint64_t nr_file_mapped = 0;     // 直接映射的文件页数（没有复制）
+
+// fork 与写时复制统计，fork 耗时只计 mm_copy（TSC 周期）
+static uint64_t nr_forks = 0, fork_cycles = 0, fork_cycles_max = 0;
+static uint64_t nr_cow_shared = 0;      // fork 时共享的页数，即深拷贝会立即复制的页数
+static uint64_t nr_cow_copied = 0;      // 写时复制缺页中复制的页数
+static uint64_t nr_cow_reused = 0;      // 只剩一个引用、直接恢复写权限的页数
+
+// find_vma 的查找次数与 mmap_cache 命中次数
+static uint64_t nr_vma_lookups = 0, nr_vma_cache_hits = 0;
+
+// munmap 一次释放至少这么多页时把各 CPU 页缓存还给 buddy，空闲页数立即反映出来，大块也能重新合并
+#define MUNMAP_DRAIN_PAGES 32
+
+static void vma_augment(rb_node_t* node);
+
+void vmm_init() {
+    mm_cache = kmem_cache_create("mm_struct_t", sizeof(mm_struct_t), CACHE_LINE_SIZE, NULL);
+    vma_cache = kmem_cache_create("vma_struct_t", sizeof(vma_struct_t), 0, NULL);
+}
 
 mm_struct_t* mm_alloc() {
     // 分配一个 mm_struct 结构体
-    mm_struct_t* mm  = (mm_struct_t*)kmalloc(sizeof(mm_struct_t));
+    mm_struct_t* mm  = (mm_struct_t*)kmem_cache_alloc(mm_cache);
     if (mm == NULL) return NULL;
     memset(mm, 0, sizeof(mm_struct_t));
 
     // 分配 PML4 页表
-    uint64_t pml4_pa = pmm_alloc_page();
+    uint64_t pml4_pa = pgtable_alloc();
     if (pml4_pa == 0) {
-        kfree(mm);
+        kmem_cache_free(mm_cache, mm);
         return NULL;    
     }
     mm->pml4_pa = pml4_pa;
     mm->pml4 = (pg_table_t*)(pml4_pa + HHDM_OFFSET);
-    memset(mm->pml4, 0, sizeof(pg_table_t));
 
     // 映射高半内核空间
     extern pg_table_t* kernel_pml4;
@@ -24,9 +61,14 @@ mm_struct_t* mm_alloc() {
 
     // 初始化 VMA 列表
     list_init(&mm->vma_list);
+    mm->mm_rb.root = NULL;
+    mm->mm_rb.augment = vma_augment;
     mm->map_count = 0;
     mm->ref_count = 0;
     mm->mmap_cache = NULL;
+    mm->numa_node = numa_node_id();
+    mm->asid = 0;
+    mm->asid_gen = 0;   // 第一次 switch_mm 时分配 asid
 
     mm->start_code = mm->end_code = 0;
     mm->start_data = mm->end_data = 0;
@@ -44,100 +86,908 @@ void mm_free(mm_struct_t* mm) {
     while (node != &mm->vma_list) {
         vma_struct_t* vma = container_of(node, vma_struct_t, list_node);
         node = node->next;
-        kfree(vma);
+        kmem_cache_free(vma_cache, vma);
     }
 
     // 递归释放用户页表
     if(mm->pml4)
     {
         user_pgtable_free_recursive(mm->pml4, 4);
-        // 释放 PML4 页表对应的物理页结构
-        pmm_free_page(mm->pml4_pa);
+        // 低半部分已被逐项清零，再清掉复制来的内核高半部分，PML4 放回页表快表
+        memset(&mm->pml4->entries[256], 0, 256 * sizeof(pte_t));
+        pgtable_free(mm->pml4_pa);
     }
     // 释放 mm_struct 本身
-    kfree(mm);
+    kmem_cache_free(mm_cache, mm);
 }
 
-bool mm_map_range(mm_struct_t* mm,uintptr_t va,uintptr_t size,uint64_t vm_flags) {
-    if(mm==NULL || size == 0) return false;
+void switch_mm(mm_struct_t* mm) {
+    if(!pcid_enabled) {
+        lcr3(mm->pml4_pa);
+        return;
+    }
 
-    uint64_t start = ALIGN_DOWN(va,PAGE_SIZE);
-    uint64_t end = ALIGN_UP(va+size,PAGE_SIZE);
-    uint64_t pages = (end - start) / PAGE_SIZE;
+    uint64_t flags = irq_save();
+    bool flush = false;
+    if(mm->asid_gen != asid_generation) {
+        if(next_asid == MM_NR_ASIDS) {
+            asid_generation++;
+            next_asid = 1;
+        }
+        mm->asid = next_asid++;
+        mm->asid_gen = asid_generation;
+        flush = true;
+    }
+    uint64_t cr3 = mm->pml4_pa | mm->asid;
+    if(!flush) cr3 |= CR3_NOFLUSH;
+    lcr3(cr3);
+    irq_restore(flags);
+}
+
+void mm_flush_tlb(mm_struct_t* mm) {
+    if((rcr3() & ~CR3_PCID_MASK) == mm->pml4_pa) {
+        // 当前地址空间：不带 NOFLUSH 重新加载，刷掉本 PCID 的非全局项
+        lcr3(rcr3());
+        return;
+    }
+    mm->asid_gen = 0;
+}
+
+/**
+ * @brief 按当前策略判断 vma 是否可以用透明大页，共享映射不用
+ * 
+ * @param vma 
+ * @return bool 
+ */
+static bool thp_vma_allowed(vma_struct_t* vma) {
+    if(vma->vm_flags & VM_SHARED) return false;
+    switch(thp_policy) {
+    case THP_ALWAYS:
+        return true;
+    case THP_MADVISE:
+        return vma->vm_flags & VM_HUGEPAGE;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief 分配一个清零的 2MiB 物理块，以 PD 级大页映射到 va
+ * 
+ * @return bool 分配失败或该处已有页表时返回 false，由调用者改用小页
+ */
+static bool thp_map(mm_struct_t* mm, uint64_t va, uint64_t pte_flags) {
+    uint64_t pa = pmm_alloc_pages_node(mm->numa_node, HUGE_PAGE_ORDER);
+    if(pa == 0) {
+        nr_thp_fallback++;
+        return false;
+    }
+    memset((void*)(pa + HHDM_OFFSET), 0, PAGE_SIZE_2M);
+    if(!vmm_map_huge(mm->pml4, va, pa, PAGE_SIZE_2M, pte_flags)) {
+        pmm_free_pages(pa, HUGE_PAGE_ORDER);
+        nr_thp_fallback++;
+        return false;
+    }
+    // 每个子页记一次映射，拆分之后就能按小页逐个释放
+    for(size_t i = 0; i < HUGE_PAGE_NR; i++) pa2page(pa + i * PAGE_SIZE)->mapcount = 1;
+    nr_user_huge++;
+    nr_thp_alloc++;
+    return true;
+}
+
+/**
+ * @brief 用户虚拟地址 va 对应的物理地址，va 落在大页中时加上页内偏移
+ * 
+ * @return uint64_t 未映射返回 0
+ */
+static uint64_t user_va2pa(pg_table_t* pml4, uint64_t va) {
+    uint64_t size;
+    pte_t* leaf = vmm_get_leaf(pml4, va, &size);
+    if(leaf == NULL || !(*leaf & PTE_PRESENT)) return 0;
+    return PTE_GET_ADDR(*leaf) + (va & (size - 1));
+}
+
+/**
+ * @brief 转换 vm_flags 到 pte_flags
+ * 
+ */
+static uint64_t vma_pte_flags(vma_struct_t* vma) {
+    uint64_t pte_flags = PTE_PRESENT | PTE_USER;
+    if(vma->vm_flags & VM_WRITE) pte_flags |= PTE_RW;
+    //if(!(vma->vm_flags & VM_EXEC)) pte_flags |= PTE_NX;
+    return pte_flags;
+}
+
+/**
+ * @brief vma 之前的空闲间隙：从前一个 VMA 的结尾（没有则为 MMAP_MIN_ADDR）到 vm_start
+ * 
+ */
+static uint64_t vma_gap(vma_struct_t* vma) {
+    list_node_t* prev = vma->list_node.prev;
+    uint64_t prev_end = MMAP_MIN_ADDR;
+    if(prev != &vma->mm->vma_list) prev_end = container_of(prev, vma_struct_t, list_node)->vm_end;
+    return vma->vm_start > prev_end ? vma->vm_start - prev_end : 0;
+}
+
+/**
+ * @brief 红黑树的增强回调：子树中最大的间隙 = max(自身之前的间隙, 左右子树的最大间隙)
+ * 
+ */
+static void vma_augment(rb_node_t* node) {
+    vma_struct_t* vma = rb_entry(node, vma_struct_t, rb_node);
+    uint64_t gap = vma_gap(vma);
+    if(node->left) {
+        uint64_t left = rb_entry(node->left, vma_struct_t, rb_node)->rb_subtree_gap;
+        if(left > gap) gap = left;
+    }
+    if(node->right) {
+        uint64_t right = rb_entry(node->right, vma_struct_t, rb_node)->rb_subtree_gap;
+        if(right > gap) gap = right;
+    }
+    vma->rb_subtree_gap = gap;
+}
+
+static vma_struct_t* vma_next(mm_struct_t* mm, vma_struct_t* vma) {
+    if(vma->list_node.next == &mm->vma_list) return NULL;
+    return container_of(vma->list_node.next, vma_struct_t, list_node);
+}
+
+/**
+ * @brief vma 之前的间隙变了（前一个 VMA 的结尾或自身的起点变化），更新到根
+ * 
+ */
+static void vma_gap_update(mm_struct_t* mm, vma_struct_t* vma) {
+    if(vma) rb_propagate(&mm->mm_rb, &vma->rb_node);
+}
+
+/**
+ * @brief 把 vma 按 vm_start 插入红黑树和有序链表，调用者保证不与已有的 VMA 重叠
+ * 
+ */
+static void vma_link(mm_struct_t* mm, vma_struct_t* vma) {
+    rb_node_t** link = &mm->mm_rb.root;
+    rb_node_t* parent = NULL;
+    vma_struct_t* prev = NULL;
+    while(*link) {
+        parent = *link;
+        vma_struct_t* cur = rb_entry(parent, vma_struct_t, rb_node);
+        if(vma->vm_start < cur->vm_start) {
+            link = &parent->left;
+        } else {
+            prev = cur;
+            link = &parent->right;
+        }
+    }
+    // 链表与树同序，先挂链表，增强回调计算间隙时要用到前一个 VMA
+    list_add_after(&vma->list_node, prev ? &prev->list_node : &mm->vma_list);
+    rb_link_node(&vma->rb_node, parent, link);
+    rb_insert_color(&mm->mm_rb, &vma->rb_node);
+    // 后一个 VMA 之前的间隙被 vma 占掉了一部分
+    vma_gap_update(mm, vma_next(mm, vma));
+    mm->map_count++;
+}
+
+/**
+ * @brief 把 vma 从红黑树和链表中摘下，不释放
+ * 
+ */
+static void vma_unlink(mm_struct_t* mm, vma_struct_t* vma) {
+    vma_struct_t* next = vma_next(mm, vma);
+    list_del(&vma->list_node);
+    rb_erase(&mm->mm_rb, &vma->rb_node);
+    vma_gap_update(mm, next);
+    if(mm->mmap_cache == vma) mm->mmap_cache = NULL;
+    mm->map_count--;
+}
+
+/**
+ * @brief 查找包含 addr 的 VMA，先看上次命中的 mmap_cache，再查红黑树
+ * 
+ * @return vma_struct_t* 没有则返回 NULL
+ */
+static vma_struct_t* find_vma(mm_struct_t* mm, uint64_t addr) {
+    nr_vma_lookups++;
+    vma_struct_t* vma = mm->mmap_cache;
+    if(vma && addr >= vma->vm_start && addr < vma->vm_end) {
+        nr_vma_cache_hits++;
+        return vma;
+    }
+    rb_node_t* node = mm->mm_rb.root;
+    while(node) {
+        vma = rb_entry(node, vma_struct_t, rb_node);
+        if(addr < vma->vm_start) {
+            node = node->left;
+        } else if(addr >= vma->vm_end) {
+            node = node->right;
+        } else {
+            mm->mmap_cache = vma;
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 查找第一个结尾在 addr 之后的 VMA（包含 addr，或整个位于 addr 之后）
+ * 
+ * @return vma_struct_t* 没有则返回 NULL
+ */
+static vma_struct_t* find_vma_after(mm_struct_t* mm, uint64_t addr) {
+    vma_struct_t* found = NULL;
+    rb_node_t* node = mm->mm_rb.root;
+    while(node) {
+        vma_struct_t* vma = rb_entry(node, vma_struct_t, rb_node);
+        if(vma->vm_end > addr) {
+            found = vma;
+            if(vma->vm_start <= addr) break;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief 在 addr 处把 vma 一分为二，vma 保留低半部分
+ * 
+ * @return vma_struct_t* 新建的高半部分，分配失败返回 NULL
+ */
+static vma_struct_t* vma_split(mm_struct_t* mm, vma_struct_t* vma, uint64_t addr) {
+    vma_struct_t* high = (vma_struct_t*)kmem_cache_alloc(vma_cache);
+    if(high == NULL) return NULL;
+    *high = *vma;
+    high->vm_start = addr;
+    high->vm_pgoff += (addr - vma->vm_start) / PAGE_SIZE;
+    vma->vm_end = addr;
+    vma_link(mm, high);
+    return high;
+}
+
+/**
+ * @brief vma 与后一个 VMA 首尾相接、标志相同（文件映射还要求是同一文件的相邻部分）时把后者并进来
+ * 
+ * @return bool 是否合并
+ */
+static bool vma_merge_next(mm_struct_t* mm, vma_struct_t* vma) {
+    vma_struct_t* next = vma_next(mm, vma);
+    if(next == NULL || next->vm_start != vma->vm_end || next->vm_flags != vma->vm_flags) return false;
+    if(next->vm_file != vma->vm_file) return false;
+    if(vma->vm_file && next->vm_pgoff != vma->vm_pgoff + (vma->vm_end - vma->vm_start) / PAGE_SIZE) return false;
+    uint64_t end = next->vm_end;
+    vma_unlink(mm, next);
+    kmem_cache_free(vma_cache, next);
+    vma->vm_end = end;
+    vma_gap_update(mm, vma_next(mm, vma));
+    return true;
+}
+
+/**
+ * @brief 合并 [start, end) 及其两侧首尾相接、标志相同的 VMA
+ * 
+ */
+static void vma_merge_range(mm_struct_t* mm, uint64_t start, uint64_t end) {
+    vma_struct_t* vma = find_vma_after(mm, start ? start - 1 : 0);
+    while(vma && vma->vm_start <= end) {
+        if(!vma_merge_next(mm, vma)) vma = vma_next(mm, vma);
+    }
+}
+
+/**
+ * @brief 自顶向下查找 [low, high) 中能放下 len 字节的最高的空闲区间，靠最大间隙剪枝
+ * 
+ * @return uint64_t 区间起始地址，找不到返回 0
+ */
+static uint64_t vma_find_gap_topdown(mm_struct_t* mm, rb_node_t* node, uint64_t len, uint64_t low, uint64_t high) {
+    if(node == NULL) return 0;
+    vma_struct_t* vma = rb_entry(node, vma_struct_t, rb_node);
+    if(vma->rb_subtree_gap < len) return 0;
+    // 右子树地址更高，先找
+    if(vma->vm_start < high) {
+        uint64_t addr = vma_find_gap_topdown(mm, node->right, len, low, high);
+        if(addr) return addr;
+    }
+    uint64_t gap_end = vma->vm_start < high ? vma->vm_start : high;
+    uint64_t gap_start = vma->vm_start - vma_gap(vma);
+    if(gap_start < low) gap_start = low;
+    if(gap_end > gap_start && gap_end - gap_start >= len) return gap_end - len;
+    return vma_find_gap_topdown(mm, node->left, len, low, high);
+}
 
-    // 创建 VMA 结构体并加入链表
-    vma_struct_t* vma = (vma_struct_t*)kmalloc(sizeof(vma_struct_t));
-    if(vma==NULL) return false;
+uint64_t mm_find_gap(mm_struct_t* mm, uint64_t len, uint64_t high) {
+    len = ALIGN_UP(len, PAGE_SIZE);
+    // 最后一个 VMA 之上到 high 的空间不属于任何 VMA 之前的间隙，单独检查
+    uint64_t top_start = MMAP_MIN_ADDR;
+    if(mm->vma_list.prev != &mm->vma_list) top_start = container_of(mm->vma_list.prev, vma_struct_t, list_node)->vm_end;
+    if(high > top_start && high - top_start >= len) return high - len;
+    return vma_find_gap_topdown(mm, mm->mm_rb.root, len, MMAP_MIN_ADDR, high);
+}
+
+/**
+ * @brief 为 vma 中尚未映射的 addr 分配一个清零的页：所在 2MiB 整段都在 vma 内、
+ *        还没有页表且策略允许时用大页，否则用 4KiB 页
+ * 
+ * @return bool 内存不足返回 false
+ */
+static bool do_anonymous_page(mm_struct_t* mm, vma_struct_t* vma, uint64_t addr) {
+    uint64_t pte_flags = vma_pte_flags(vma);
+    uint64_t huge = ALIGN_DOWN(addr, PAGE_SIZE_2M);
+    if(thp_vma_allowed(vma) && huge >= vma->vm_start && huge + PAGE_SIZE_2M <= vma->vm_end
+        && vmm_get_pt(mm->pml4, huge, false, 0) == NULL && thp_map(mm, huge, pte_flags)) {
+        return true;
+    }
+    // 用户页必须清零，防止泄露其他进程的数据
+    if(vmm_map_alloc(mm->pml4, ALIGN_DOWN(addr, PAGE_SIZE), 1, pte_flags, pmm_alloc_zeroed_page_node, mm->numa_node) != 1) {
+        return false;
+    }
+    nr_small_mapped++;
+    return true;
+}
+
+/**
+ * @brief 为 [start, end) 新建一个 VMA，调用者保证这段地址空闲
+ * 
+ * @return bool 分配失败返回 false
+ */
+static bool vma_insert(mm_struct_t* mm, uint64_t start, uint64_t end, uint64_t vm_flags,
+                       struct ramfs_node* file, uint64_t pgoff) {
+    vma_struct_t* vma = (vma_struct_t*)kmem_cache_alloc(vma_cache);
+    if(vma == NULL) return false;
     vma->vm_start = start;
     vma->vm_end = end;
     vma->vm_flags = vm_flags;
+    vma->vm_file = file;
+    vma->vm_pgoff = pgoff;
     vma->mm = mm;
-    list_add_before(&vma->list_node,&mm->vma_list);
-    mm->map_count++;
+    vma_link(mm, vma);
+    return true;
+}
 
-    // 转换 vm_flags 到 pte_flags
-    uint64_t pte_flags = PTE_PRESENT | PTE_USER;
-    if(vm_flags & VM_WRITE) pte_flags |= PTE_RW;
-    //if(!(vm_flags & VM_EXEC)) pte_flags |= PTE_NX;
-
-    // 映射每一页
-    for(uint64_t i=0;i<pages;i++) {
-        uint64_t va = start + i * PAGE_SIZE;
-        uint64_t pa = pmm_alloc_page();
-        if(pa==0) {
-            // 映射失败，回滚已映射的页
-            for(uint64_t j=0;j<i;j++) {
-                uint64_t rollback_va = start + j * PAGE_SIZE;
-                pte_t* pte = vmm_get_pte(mm->pml4,rollback_va);
-                if(pte && (*pte & PTE_PRESENT)) {
-                    uintptr_t pa = PTE_GET_ADDR(*pte);
-                    pmm_free_page(pa);
-                    *pte = 0;
-                }
-            }
-            kfree(vma);
-            return false;
+/**
+ * @brief 把文件页直接映射到 addr，不复制。私有映射先只读映射，写时复制；
+ *        页缓存持有一次引用，写时复制因此总会复制而不会把文件页据为己有
+ * 
+ * @return bool 超出文件末尾或内存不足返回 false
+ */
+static bool do_file_page(mm_struct_t* mm, vma_struct_t* vma, uint64_t addr) {
+    uint64_t va = ALIGN_DOWN(addr, PAGE_SIZE);
+    uint64_t pa = ramfs_get_page(vma->vm_file, vma->vm_pgoff + (va - vma->vm_start) / PAGE_SIZE);
+    if(pa == 0) return false;
+    uint64_t pte_flags = vma_pte_flags(vma);
+    if(!(vma->vm_flags & VM_SHARED)) pte_flags &= ~PTE_RW;
+    pg_table_t* pt = vmm_get_pt(mm->pml4, va, true, pte_flags);
+    if(pt == NULL) return false;
+    page_t* page = pa2page(pa);
+    get_page(page);
+    page->mapcount++;
+    pt->entries[PT_IDX(va)] = pa | pte_flags;
+    nr_file_mapped++;
+    return true;
+}
+
+bool mm_map_range(mm_struct_t* mm,uintptr_t va,uintptr_t size,uint64_t vm_flags) {
+    if(mm==NULL || size == 0) return false;
+
+    uint64_t start = ALIGN_DOWN(va,PAGE_SIZE);
+    uint64_t end = ALIGN_UP(va+size,PAGE_SIZE);
+
+    // 已经属于某个 VMA 的部分保持原样（相邻的 ELF 段可能共用一页），只为其间的空洞创建 VMA，
+    // 物理页等到第一次访问时由缺页处理分配
+    uint64_t cur = start;
+    while(cur < end) {
+        vma_struct_t* next = find_vma_after(mm, cur);
+        if(next && next->vm_start <= cur) {
+            cur = next->vm_end;
+            continue;
         }
-        vmm_map_page(mm->pml4, va, pa, pte_flags);
+        uint64_t hole_end = (next && next->vm_start < end) ? next->vm_start : end;
+        if(!vma_insert(mm, cur, hole_end, vm_flags, NULL, 0)) return false;
+        cur = hole_end;
+    }
+    // 与首尾相接、标志相同的 VMA 合并
+    vma_merge_range(mm, start, end);
+    return true;
+}
+
+bool mm_populate(mm_struct_t* mm, uintptr_t va, uintptr_t size) {
+    uint64_t end = ALIGN_UP(va + size, PAGE_SIZE);
+    for(uint64_t addr = ALIGN_DOWN(va, PAGE_SIZE); addr < end; addr += PAGE_SIZE) {
+        if(user_va2pa(mm->pml4, addr)) continue;
+        vma_struct_t* vma = find_vma(mm, addr);
+        if(vma == NULL) return false;
+        if(!(vma->vm_file ? do_file_page(mm, vma, addr) : do_anonymous_page(mm, vma, addr))) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 页只被这一处映射引用，写时可以直接恢复写权限。保留页（如 init 模块中的文件页）不归 PMM 管，总要复制
+ * 
+ */
+static inline bool page_reusable(page_t* page) {
+    return !(page->flags & PG_reserved) && page->refcount == 1;
+}
+
+/**
+ * @brief 写时复制：写 fork 后共享的只读页或私有文件映射的页。只剩一个引用时直接恢复写权限，否则复制一份
+ *        共享的大页先拆成 4KiB 页，只复制被写的那一页
+ * 
+ * @return bool 内存不足返回 false
+ */
+static bool do_wp_page(mm_struct_t* mm, uint64_t addr) {
+    uint64_t size;
+    pte_t* pte = vmm_get_leaf(mm->pml4, addr, &size);
+    if(pte == NULL) return false;
+    if(size != PAGE_SIZE) {
+        if(!vmm_split_huge(mm->pml4, addr)) return false;
+        pte = vmm_get_leaf(mm->pml4, addr, &size);
+    }
+    void* va = (void*)ALIGN_DOWN(addr, PAGE_SIZE);
+    // 表项已经可写，是 TLB 中残留的只读项
+    if(*pte & PTE_RW) {
+        invlpg(va);
+        return true;
     }
 
+    uint64_t pa = PTE_GET_ADDR(*pte);
+    page_t* page = pa2page(pa);
+    if(page_reusable(page)) {
+        *pte |= PTE_RW;
+        nr_cow_reused++;
+    } else {
+        uint64_t new_pa = pmm_alloc_page_node(mm->numa_node);
+        if(new_pa == 0) return false;
+        memcpy((void*)(new_pa + HHDM_OFFSET), (void*)(pa + HHDM_OFFSET), PAGE_SIZE);
+        pa2page(new_pa)->mapcount = 1;
+        pa2page(new_pa)->flags |= PG_anon;
+        *pte = new_pa | PTE_GET_FLAGS(*pte) | PTE_RW;
+        page->mapcount--;
+        put_page(page);
+        nr_cow_copied++;
+    }
+    invlpg(va);
+    return true;
+}
+
+bool mm_handle_fault(mm_struct_t* mm, uint64_t addr, uint64_t err) {
+    vma_struct_t* vma = find_vma(mm, addr);
+    if(vma == NULL) return false;
+    // PROT_NONE 的区域不能访问，没有写权限的区域不能写
+    if(!(vma->vm_flags & VM_ACCESS)) return false;
+    if((err & PF_WRITE) && !(vma->vm_flags & VM_WRITE)) return false;
+    // 页存在却仍然出错：可写区域中的只读页是写时复制，其他都是非法访问
+    if(err & PF_PROT) {
+        if(err & PF_WRITE) return do_wp_page(mm, addr);
+        return false;
+    }
+    if(vma->vm_file) {
+        if(!do_file_page(mm, vma, addr)) return false;
+        // 私有映射的写缺页：文件页刚以只读映射上，直接复制，不必再触发一次写保护缺页
+        if((err & PF_WRITE) && !(vma->vm_flags & VM_SHARED)) return do_wp_page(mm, addr);
+        return true;
+    }
+    return do_anonymous_page(mm, vma, addr);
+}
+
+int mm_madvise(mm_struct_t* mm, uint64_t addr, uint64_t len, int advice) {
+    if(advice != MADV_HUGEPAGE && advice != MADV_NOHUGEPAGE) return -1;
+    uint64_t start = ALIGN_DOWN(addr, PAGE_SIZE);
+    uint64_t end = ALIGN_UP(addr + len, PAGE_SIZE);
+    // 只改范围内的部分：跨边界的 VMA 先在边界处拆开
+    vma_struct_t* vma = find_vma_after(mm, start);
+    while(vma && vma->vm_start < end) {
+        if(vma->vm_start < start && (vma = vma_split(mm, vma, start)) == NULL) return -1;
+        if(vma->vm_end > end && vma_split(mm, vma, end) == NULL) return -1;
+        if(advice == MADV_HUGEPAGE) vma->vm_flags |= VM_HUGEPAGE;
+        else vma->vm_flags &= ~VM_HUGEPAGE;
+        vma = vma_next(mm, vma);
+    }
+    vma_merge_range(mm, start, end);
+    return 0;
+}
+
+static uint64_t prot_to_vm(int prot) {
+    uint64_t vm_flags = 0;
+    if(prot & PROT_READ) vm_flags |= VM_READ;
+    if(prot & PROT_WRITE) vm_flags |= VM_WRITE;
+    if(prot & PROT_EXEC) vm_flags |= VM_EXEC;
+    return vm_flags;
+}
+
+/**
+ * @brief 释放 addr 所在空闲间隙（前后两个 VMA 之间）中的空页表，间隙里不会再有映射
+ * 
+ */
+static void free_gap_pgtables(mm_struct_t* mm, uint64_t addr, tlb_gather_t* tlb) {
+    vma_struct_t* next = find_vma_after(mm, addr);
+    list_node_t* prev = next ? next->list_node.prev : mm->vma_list.prev;
+    uint64_t floor = prev != &mm->vma_list ? container_of(prev, vma_struct_t, list_node)->vm_end : 0;
+    uint64_t ceiling = next ? next->vm_start : USER_SPACE_END;
+    vmm_free_pgtables(mm->pml4, floor, ceiling, tlb);
+}
+
+uint64_t mm_mmap(mm_struct_t* mm, uint64_t addr, uint64_t len, int prot, int flags,
+                 struct ramfs_node* file, uint64_t pgoff) {
+    int type = flags & (MAP_SHARED | MAP_PRIVATE);
+    if(len == 0 || (file == NULL && !(flags & MAP_ANONYMOUS)) || (type != MAP_SHARED && type != MAP_PRIVATE)) return MAP_FAILED;
+    if(prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) return MAP_FAILED;
+    if(len > USER_SPACE_END - MMAP_MIN_ADDR) return MAP_FAILED;
+    len = ALIGN_UP(len, PAGE_SIZE);
+    uint64_t vm_flags = prot_to_vm(prot);
+    if(type == MAP_SHARED) vm_flags |= VM_SHARED;
+
+    if(flags & MAP_FIXED) {
+        if((addr & (PAGE_SIZE - 1)) || addr < MMAP_MIN_ADDR || addr > USER_SPACE_END - len) return MAP_FAILED;
+        // 覆盖范围内原有的映射
+        if(mm_munmap(mm, addr, len) < 0) return MAP_FAILED;
+    } else {
+        // addr 只是提示：那里放得下就用，否则自顶向下找
+        addr = ALIGN_DOWN(addr, PAGE_SIZE);
+        vma_struct_t* next = find_vma_after(mm, addr);
+        if(addr < MMAP_MIN_ADDR || addr > USER_SPACE_END - len || (next && next->vm_start < addr + len)) {
+            addr = mm_find_gap(mm, len, MMAP_BASE);
+            if(addr == 0) return MAP_FAILED;
+        }
+    }
+    if(!vma_insert(mm, addr, addr + len, vm_flags, file, pgoff)) return MAP_FAILED;
+    vma_merge_range(mm, addr, addr + len);
+    return addr;
+}
+
+int mm_munmap(mm_struct_t* mm, uint64_t addr, uint64_t len) {
+    uint64_t end = ALIGN_UP(addr + len, PAGE_SIZE);
+    if((addr & (PAGE_SIZE - 1)) || len == 0 || end <= addr || end > USER_SPACE_END) return -1;
+
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, mm->pml4);
+    size_t unmapped = 0;
+    int ret = 0;
+    vma_struct_t* vma = find_vma_after(mm, addr);
+    while(vma && vma->vm_start < end) {
+        // 跨边界的 VMA 先在边界处拆开，只删除范围内的部分
+        if(vma->vm_start < addr && (vma = vma_split(mm, vma, addr)) == NULL) {
+            ret = -1;
+            break;
+        }
+        if(vma->vm_end > end && vma_split(mm, vma, end) == NULL) {
+            ret = -1;
+            break;
+        }
+        vma_struct_t* next = vma_next(mm, vma);
+        // 跨出范围的大页由 vmm_unmap_range 拆开，只解除范围内的部分
+        unmapped += vmm_unmap_range(mm->pml4, vma->vm_start, (vma->vm_end - vma->vm_start) / PAGE_SIZE, &tlb);
+        vma_unlink(mm, vma);
+        kmem_cache_free(vma_cache, vma);
+        vma = next;
+    }
+    free_gap_pgtables(mm, addr, &tlb);
+    // 页数不超过一批时只在这里失效一次，物理页和页表页随后释放
+    tlb_gather_flush(&tlb);
+    if(tlb.stale) mm_flush_tlb(mm);
+    if(unmapped >= MUNMAP_DRAIN_PAGES) pcp_drain_all();
+    return ret;
+}
+
+/**
+ * @brief 按 vma 的新权限就地改写其中已映射的表项，待失效的范围记到 tlb
+ *        跨出 vma 的大页和 PROT_NONE 区域中的大页先拆成小页（清掉 PTE_USER 的大页无法按用户大页统计）
+ * 
+ * @return bool 拆分大页失败返回 false
+ */
+static bool vma_change_protection(mm_struct_t* mm, vma_struct_t* vma, tlb_gather_t* tlb) {
+    bool none = !(vma->vm_flags & VM_ACCESS);
+    uint64_t va = vma->vm_start;
+    while(va < vma->vm_end) {
+        uint64_t size;
+        pte_t* leaf = vmm_get_leaf(mm->pml4, va, &size);
+        if(leaf == NULL) {
+            va = ALIGN_DOWN(va, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+            continue;
+        }
+        if(!(*leaf & PTE_PRESENT)) {
+            va += size;
+            continue;
+        }
+        uint64_t base = ALIGN_DOWN(va, size);
+        if(size != PAGE_SIZE && (none || base < vma->vm_start || base + size > vma->vm_end)) {
+            if(!vmm_split_huge(mm->pml4, va)) return false;
+            continue;
+        }
+        pte_t entry = *leaf & ~(PTE_RW | PTE_USER);
+        // x86 无法让存在的用户页不可读，PROT_NONE 的页改成只有内核能访问
+        if(!none) entry |= PTE_USER;
+        // 写时复制中仍被共享的页保持只读，第一次写时再复制
+        if((vma->vm_flags & VM_WRITE) && ((vma->vm_flags & VM_SHARED) || page_reusable(pa2page(PTE_GET_ADDR(entry))))) {
+            entry |= PTE_RW;
+        }
+        *leaf = entry;
+        va = base + size;
+    }
+    tlb_gather_range(tlb, vma->vm_start, vma->vm_end);
+    return true;
+}
+
+int mm_mprotect(mm_struct_t* mm, uint64_t addr, uint64_t len, int prot) {
+    uint64_t end = ALIGN_UP(addr + len, PAGE_SIZE);
+    if((addr & (PAGE_SIZE - 1)) || end < addr || (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))) return -1;
+    if(end == addr) return 0;
+    // 先确认范围被 VMA 完整覆盖，不做到一半才失败
+    uint64_t cur = addr;
+    for(vma_struct_t* vma = find_vma(mm, addr); vma && vma->vm_start <= cur && cur < end; vma = vma_next(mm, vma)) {
+        cur = vma->vm_end;
+    }
+    if(cur < end) return -1;
+
+    uint64_t vm_prot = prot_to_vm(prot);
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb, mm->pml4);
+    int ret = 0;
+    vma_struct_t* vma = find_vma(mm, addr);
+    while(vma && vma->vm_start < end) {
+        if(vma->vm_start < addr && (vma = vma_split(mm, vma, addr)) == NULL) {
+            ret = -1;
+            break;
+        }
+        if(vma->vm_end > end && vma_split(mm, vma, end) == NULL) {
+            ret = -1;
+            break;
+        }
+        vma->vm_flags = (vma->vm_flags & ~VM_ACCESS) | vm_prot;
+        if(!vma_change_protection(mm, vma, &tlb)) {
+            ret = -1;
+            break;
+        }
+        vma = vma_next(mm, vma);
+    }
+    // 只改了权限没有释放页，整个范围一次失效
+    tlb_gather_flush(&tlb);
+    if(tlb.stale) mm_flush_tlb(mm);
+    vma_merge_range(mm, addr, end);
+    return ret;
+}
+
+uint64_t mm_brk(mm_struct_t* mm, uint64_t brk) {
+    if(brk < mm->start_heap || brk > MMAP_BASE) return mm->heap;
+    uint64_t old_end = ALIGN_UP(mm->heap, PAGE_SIZE);
+    uint64_t new_end = ALIGN_UP(brk, PAGE_SIZE);
+    if(new_end < old_end) {
+        // 收缩：解除多出来的页，物理页和页表随之释放
+        if(mm_munmap(mm, new_end, old_end - new_end) < 0) return mm->heap;
+    } else if(new_end > old_end) {
+        // 扩展：不能压到其上的映射；页在第一次访问时才分配
+        vma_struct_t* next = find_vma_after(mm, old_end);
+        if(next && next->vm_start < new_end) return mm->heap;
+        vma_struct_t* heap = old_end > mm->start_heap ? find_vma(mm, old_end - 1) : NULL;
+        if(heap && (heap->vm_flags & VM_HEAP)) {
+            // 堆始终是一个 VMA，原地延长；后一个 VMA 之前的间隙随之变小
+            heap->vm_end = new_end;
+            vma_gap_update(mm, vma_next(mm, heap));
+        } else if(!vma_insert(mm, old_end, new_end, VM_READ | VM_WRITE | VM_HEAP, NULL, 0)) {
+            return mm->heap;
+        }
+    }
+    mm->heap = brk;
+    return brk;
+}
+
+size_t mm_resident_pages(mm_struct_t* mm, uint64_t start, uint64_t end) {
+    size_t resident = 0;
+    uint64_t va = ALIGN_DOWN(start, PAGE_SIZE);
+    while(va < end) {
+        uint64_t size;
+        pte_t* leaf = vmm_get_leaf(mm->pml4, va, &size);
+        if(leaf == NULL) {
+            va = ALIGN_DOWN(va, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+            continue;
+        }
+        // 大页只计落在范围内的部分
+        uint64_t next = ALIGN_DOWN(va, size) + size;
+        if(*leaf & PTE_PRESENT) resident += ((next < end ? next : ALIGN_UP(end, PAGE_SIZE)) - va) / PAGE_SIZE;
+        va = next;
+    }
+    return resident;
+}
+
+void vma_dump_stats() {
+    kprintf("VMA: %ld lookups, %ld mmap_cache hits (%ld%%)\n",
+        nr_vma_lookups, nr_vma_cache_hits, nr_vma_lookups ? nr_vma_cache_hits * 100 / nr_vma_lookups : 0);
+    kprintf("File mmap: %ld pages mapped without copying\n", nr_file_mapped);
+}
+
+void thp_dump_stats() {
+    static const char* names[] = { "", "always", "madvise", "never" };
+    kprintf("THP [%s]: %ld huge pages mapped (%ld installed, %ld fallbacks, %ld splits), %ld small pages mapped\n",
+        names[thp_policy], nr_user_huge, nr_thp_alloc, nr_thp_fallback, nr_huge_split, nr_small_mapped);
+}
+
+void cow_dump_stats() {
+    kprintf("fork: %ld forks, mm_copy avg %ld cycles (max %ld)\n",
+        nr_forks, nr_forks ? fork_cycles / nr_forks : 0, fork_cycles_max);
+    kprintf("COW: %ld pages shared at fork (a deep copy copies them eagerly), %ld copied lazily on write, %ld reused\n",
+        nr_cow_shared, nr_cow_copied, nr_cow_reused);
+}
+
+/**
+ * @brief 打印当前进程的缺页次数，以及堆 VMA 的大小与实际驻留的页（两者之差是从未访问过的部分）
+ * 
+ */
+static void current_dump_stats() {
+    extern pcb_t* current_proc;
+    mm_struct_t* mm = current_proc->mm;
+    uint64_t heap_end = ALIGN_UP(mm->heap, PAGE_SIZE);
+    kprintf("Process %d: %ld minor faults, heap %ld KiB mapped, %ld KiB resident\n",
+        current_proc->pid, current_proc->min_flt, (heap_end - mm->start_heap) / 1024,
+        mm_resident_pages(mm, mm->start_heap, heap_end) * PAGE_SIZE / 1024);
+}
+
+int64_t thp_ctl(int cmd) {
+    switch(cmd) {
+    case THP_DUMP:
+        // 用户内存的统计一起打印
+        current_dump_stats();
+        vma_dump_stats();
+        thp_dump_stats();
+        cow_dump_stats();
+        return 0;
+    case THP_ALWAYS:
+    case THP_MADVISE:
+    case THP_NEVER:
+        thp_policy = cmd;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief 把父进程的叶子表项 entry 原样装进子进程，物理页多一次引用和映射
+ * 
+ * @param size 表项映射的大小，4KiB 或 2MiB
+ * @return bool 分配页表失败返回 false
+ */
+static bool cow_share(mm_struct_t* dst, uint64_t va, pte_t entry, uint64_t size) {
+    uint64_t pa = PTE_GET_ADDR(entry);
+    if(size == PAGE_SIZE) {
+        // PROT_NONE 的页清掉了 PTE_USER，中间表项仍要按用户页建
+        pg_table_t* pt = vmm_get_pt(dst->pml4, va, true, PTE_USER);
+        if(pt == NULL) return false;
+        pt->entries[PT_IDX(va)] = entry;
+    } else {
+        if(!vmm_map_huge(dst->pml4, va, pa, PAGE_SIZE_2M, PTE_GET_FLAGS(entry))) return false;
+        nr_user_huge++;
+    }
+    for(size_t i = 0; i < size / PAGE_SIZE; i++) {
+        page_t* page = pa2page(pa + i * PAGE_SIZE);
+        get_page(page);
+        page->mapcount++;
+    }
     return true;
 }
 
 bool mm_copy(mm_struct_t* dst, mm_struct_t* src) {
     if(dst == NULL || src == NULL) return false;
+    uint64_t begin = rdtsc();
+    size_t shared = 0;
+    bool ok = true;
+
+    // 段与堆的边界随地址空间一起继承，子进程的 brk 接着父进程的堆顶
+    dst->start_code = src->start_code;
+    dst->end_code = src->end_code;
+    dst->start_data = src->start_data;
+    dst->end_data = src->end_data;
+    dst->start_heap = src->start_heap;
+    dst->heap = src->heap;
+    dst->start_stack = src->start_stack;
 
     // 遍历父进程的 VMA 列表
     list_node_t* node = src->vma_list.next;
-    while(node != &src->vma_list) {
+    while(node != &src->vma_list && ok) {
         vma_struct_t* src_vma = container_of(node, vma_struct_t, list_node);
         node = node->next;
-        // 在子进程中映射相同的虚拟地址范围
-        if(!mm_map_range(dst, src_vma->vm_start, src_vma->vm_end - src_vma->vm_start, src_vma->vm_flags)) {
-            // 映射失败，释放已映射的部分
-            mm_free(dst);
-            return false;
-        }
-        // 物理内存深拷贝 (Deep Copy)
-        for(uint64_t vaddr = src_vma->vm_start; vaddr < src_vma->vm_end; vaddr += PAGE_SIZE) {
-            pte_t* src_pte = vmm_get_pte(src->pml4, vaddr);
-            pte_t* dst_pte = vmm_get_pte(dst->pml4, vaddr);
-            if(src_pte == NULL || dst_pte == NULL || !(*src_pte & PTE_PRESENT)) {
-                continue; // 源页表项不存在或未映射
+        // 在子进程中映射相同的虚拟地址范围，文件映射连同文件和偏移一起复制
+        if(!vma_insert(dst, src_vma->vm_start, src_vma->vm_end, src_vma->vm_flags, src_vma->vm_file, src_vma->vm_pgoff)) {
+            ok = false;
+            break;
+        }
+        // 私有可写区域的页父子双方都改成只读，谁先写谁复制；只读和共享区域直接共用
+        bool cow = (src_vma->vm_flags & (VM_WRITE | VM_SHARED)) == VM_WRITE;
+        uint64_t vaddr = src_vma->vm_start;
+        while(vaddr < src_vma->vm_end) {
+            uint64_t size;
+            pte_t* leaf = vmm_get_leaf(src->pml4, vaddr, &size);
+            if(leaf == NULL) {
+                // 整张页表都不存在，跳到下一个 2MiB
+                vaddr = ALIGN_DOWN(vaddr, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+                continue;
             }
-            // 
-            uintptr_t src_pa = PTE_GET_ADDR(*src_pte);
-            uintptr_t dst_pa = PTE_GET_ADDR(*dst_pte);
-            if(dst_pa == 0) {
-                // 分配失败，释放已分配的部分
-                mm_free(dst);
-                return false;
+            if(*leaf & PTE_PRESENT) {
+                if(cow) *leaf &= ~PTE_RW;
+                if(!cow_share(dst, vaddr, *leaf, size)) {
+                    ok = false;
+                    break;
+                }
+                shared += size / PAGE_SIZE;
             }
-            // 拷贝数据
-            memcpy((void*)(dst_pa + HHDM_OFFSET), (void*)(src_pa + HHDM_OFFSET), PAGE_SIZE);
-            // 更新子进程页表项
-            *dst_pte = (dst_pa & 0x000FFFFFFFFFF000) | (*src_pte & 0xFFF); // 保留标志位
+            vaddr += size;
         }
     }
+    // 父进程刚被改成只读的表项可能还以可写的形式留在 TLB 中，统一刷新一次
+    if(shared) mm_flush_tlb(src);
+    // 失败时 dst 由调用者连同进程一起释放（sys_fork 中的 free_proc），这里再释放就重复了；
+    // 父进程多出来的只读页在下次写入时发现只剩一个引用，直接恢复写权限
+    if(!ok) return false;
+
+    uint64_t cycles = rdtsc() - begin;
+    nr_forks++;
+    fork_cycles += cycles;
+    if(cycles > fork_cycles_max) fork_cycles_max = cycles;
+    nr_cow_shared += shared;
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 迁移 mm 中映射到 [start_pgidx, end_pgidx) 的用户页
+ * 
+ * @param mm 
+ * @param start_pgidx 
+ * @param end_pgidx 
+ * @return size_t 迁移的页数
+ */
+static size_t mm_migrate_mm(mm_struct_t* mm, size_t start_pgidx, size_t end_pgidx) {
+    size_t migrated = 0;
+    bool oom = false;
+    list_node_t* node = mm->vma_list.next;
+    while(node != &mm->vma_list && !oom) {
+        vma_struct_t* vma = container_of(node, vma_struct_t, list_node);
+        node = node->next;
+        uint64_t vaddr = vma->vm_start;
+        while(vaddr < vma->vm_end && !oom) {
+            uint64_t next = ALIGN_DOWN(vaddr, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+            if(next > vma->vm_end) next = vma->vm_end;
+            // 每个 2MiB 只走一次页表；页表不存在或是透明大页（不参与迁移）时整段跳过
+            pg_table_t* pt = vmm_get_pt(mm->pml4, vaddr, false, 0);
+            for(; pt != NULL && vaddr < next; vaddr += PAGE_SIZE) {
+                pte_t* pte = &pt->entries[PT_IDX(vaddr)];
+                if(!(*pte & PTE_PRESENT)) continue;
+                uint64_t pa = PTE_GET_ADDR(*pte);
+                if(pa2pgidx(pa) < start_pgidx || pa2pgidx(pa) >= end_pgidx) continue;
+
+                // 共享页、文件页、已迁走的页不动
+                page_t* page = pa2page(pa);
+                if(!(page->flags & PG_anon) || (page->flags & PG_isolated) ||
+                   page->refcount != 1 || page->mapcount != 1) continue;
+
+                uint64_t new_pa = pmm_alloc_page();
+                if(new_pa == 0) {
+                    oom = true;
+                    break;
+                }
+                memcpy((void*)(new_pa + HHDM_OFFSET), (void*)(pa + HHDM_OFFSET), PAGE_SIZE);
+                *pte = new_pa | PTE_GET_FLAGS(*pte);
+                pa2page(new_pa)->mapcount = 1;
+                pa2page(new_pa)->flags |= PG_anon;
+                page->mapcount = 0;
+                page->flags |= PG_isolated;
+                migrated++;
+            }
+            vaddr = next;
+        }
+    }
+    // 直接改写的表项在所有 CPU、所有 PCID 下都可能留有旧 TLB 项，统一作废
+    if(migrated) mm_flush_tlb(mm);
+    return migrated;
+}
+
+size_t mm_migrate_range(size_t start_pgidx, size_t end_pgidx) {
+    // 遍历所有进程的地址空间（内核线程共享父进程的 mm，重复遍历时页已迁走，不会重复迁移）
+    extern list_node_t proc_list;
+    size_t migrated = 0;
+    list_node_t* node = proc_list.next;
+    while(node != &proc_list) {
+        pcb_t* proc = container_of(node, pcb_t, proc_list_node);
+        node = node->next;
+        if(proc->mm == NULL) continue;
+        migrated += mm_migrate_mm(proc->mm, start_pgidx, end_pgidx);
+    }
+    return migrated;
+}
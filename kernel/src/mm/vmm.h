@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include "../lib/list.h"
+#include "../lib/rbtree.h"
 #include "paging.h"
 
 // VMA 权限标志
@@ -10,27 +11,68 @@
 #define VM_SHARED   (1 << 3) // 是否多进程共享
 #define VM_STACK    (1 << 4) // 栈（通常向下生长）
 #define VM_HEAP     (1 << 5) // 堆
+#define VM_HUGEPAGE (1 << 6) // madvise(MADV_HUGEPAGE) 过，THP_MADVISE 策略下用大页
+#define VM_ACCESS   (VM_READ | VM_WRITE | VM_EXEC) // 三者都没有即 PROT_NONE
+
+// 透明大页策略，同时也是 SYS_THP 设置策略的命令；SYS_THP 命令 0 打印统计
+#define THP_DUMP    0
+#define THP_ALWAYS  1   // 足够大且对齐的匿名区域都用 2MiB 页
+#define THP_MADVISE 2   // 只对带 VM_HUGEPAGE 的区域使用
+#define THP_NEVER   3
+
+// SYS_MADVISE 支持的建议，取值与 Linux 相同
+#define MADV_HUGEPAGE   14
+#define MADV_NOHUGEPAGE 15
+
+// SYS_MMAP / SYS_MPROTECT 的参数，取值与 Linux 相同
+#define PROT_NONE  0x0
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
+
+#define MAP_FAILED ((uint64_t)-1)
 
 
 struct mm_struct;
+struct ramfs_node;
 
 struct vma_struct {
-    list_node_t list_node; 
+    list_node_t list_node; // 按地址排序，与红黑树同序
+    rb_node_t rb_node;     // 挂在 mm_rb 上，键为 vm_start
+    uint64_t rb_subtree_gap; // 子树中最大的空闲间隙（每个 VMA 与前一个 VMA 之间），用于查找空闲区间
     struct mm_struct * mm; // 指向所属的地址空间
     uint64_t vm_start;
     uint64_t vm_end;
     uint64_t vm_flags;
+    struct ramfs_node* vm_file; // 文件映射所映射的文件，匿名映射为 NULL
+    uint64_t vm_pgoff;          // vm_start 对应的文件页号
 };
 
+// 用户映射的最低地址，其下（含 0 页）永不映射
+#define MMAP_MIN_ADDR 0x10000
+// mmap 自此向下分配，其上 16MiB 留给用户栈（USER_STACK_TOP 为 0x80000000）
+#define MMAP_BASE 0x7F000000UL
+// 用户地址空间上界（低半部分）
+#define USER_SPACE_END 0x0000800000000000UL
+
 
 // 代表了一个进程完整的虚拟地址空间。
 struct mm_struct {
     pg_table_t* pml4;       // 该进程的顶级页表指针
     uint64_t pml4_pa;      // 该页表的物理地址
     list_node_t vma_list;   // 串联了该进程拥有的所有 VMA (虚拟内存区域)。
+    rb_root_t mm_rb;        // 同一批 VMA 的红黑树索引，按地址查找 O(log n)
     int map_count;          // vma的数量
     int ref_count;          // 记录有多少个PCB正在引用这个mm
-    struct vma_struct* mmap_cache; // 最近一次成功查找到的那个 VMA 结构体。
+    int numa_node;          // 优先从该 NUMA 节点分配用户页（创建时所在 CPU 的节点）
+    uint16_t asid;          // 加载 CR3 时使用的 PCID，asid_gen 过期则需重新分配
+    uint64_t asid_gen;      // 分配 asid 时的代数，0 表示还没有分配
+    struct vma_struct* mmap_cache; // 最近一次成功查找到的那个 VMA 结构体，find_vma 先查它
 
     uint64_t start_code, end_code; // 代码段边界
     uint64_t start_data, end_data; // 数据段边界
@@ -67,6 +109,11 @@ typedef struct vma_struct vma_struct_t;
 
 // 代表了地址空间中一段连续的区域（如代码段、栈、堆）
 
+/**
+ * @brief 创建 mm_struct / vma_struct 对象缓存，须在 kheap_init 之后调用
+ */
+void vmm_init();
+
 /**
  * @brief 分配并初始化一个新的 mm_struct 结构体
  */
@@ -78,8 +125,25 @@ mm_struct_t* mm_alloc();
  */
 void mm_free(mm_struct_t* mm);
 
+// PCID 共 12 位，0 留给没有 mm 的 CR3（内核页表、临时切换），每次加载都刷新
+#define MM_NR_ASIDS 4096
+
+/**
+ * @brief 切换到 mm 的页表。开启 PCID 时 asid 仍有效就带 NOFLUSH 加载，保留该地址空间的 TLB 项；
+ *        新分配的 asid 第一次加载时刷新，清掉上一个使用者留下的项
+ * @param mm
+ */
+void switch_mm(mm_struct_t* mm);
+
 /**
- * @brief 在指定的 mm_struct 地址空间中映射一段虚拟地址范围
+ * @brief mm 的页表被改动而 invlpg 无法覆盖时调用（mm 不是当前地址空间，或改动范围很大）：
+ *        当前地址空间立即刷新，否则作废其 asid，下次加载时刷新
+ * @param mm
+ */
+void mm_flush_tlb(mm_struct_t* mm);
+
+/**
+ * @brief 在指定的 mm_struct 地址空间中映射一段虚拟地址范围，只建立 VMA，物理页在第一次访问时分配
  * @param mm 目标地址空间
  * @param va 虚拟地址起始位置
  * @param size 映射大小（字节）
@@ -89,10 +153,116 @@ void mm_free(mm_struct_t* mm);
 bool mm_map_range(mm_struct_t* mm,uintptr_t va,uintptr_t size,uint64_t flags);
 
 /**
- * @brief 复制地址空间：src -> dst
+ * @brief 自顶向下查找 [MMAP_MIN_ADDR, high) 中能放下 len 字节的最高的空闲区间，按 VMA 间隙剪枝，O(log n)
+ * @return uint64_t 区间起始地址（页对齐），找不到返回 0
+ */
+uint64_t mm_find_gap(mm_struct_t* mm, uint64_t len, uint64_t high);
+
+/**
+ * @brief 为 [va, va + size) 中尚未映射的页预先分配物理页，不必经过缺页；
+ *        内核在 mm 不是当前进程的地址空间时写入用户内存（如加载 ELF）之前调用
+ * @return true 成功，false 地址不在 VMA 中或内存不足
+ */
+bool mm_populate(mm_struct_t* mm, uintptr_t va, uintptr_t size);
+
+// 缺页异常错误码
+#define PF_PROT  (1 << 0)   // 0: 页不存在，1: 页存在但权限不符
+#define PF_WRITE (1 << 1)   // 写访问
+#define PF_USER  (1 << 2)   // 发生在用户态
+#define PF_INSTR (1 << 4)   // 取指
+
+/**
+ * @brief 处理用户地址 addr 上的缺页：地址落在 VMA 中且访问合法时分配清零的页并映射
+ * @param err 缺页异常错误码
+ * @return true 已补上页，返回后重新执行出错的指令；false 非法访问或内存不足
+ */
+bool mm_handle_fault(mm_struct_t* mm, uint64_t addr, uint64_t err);
+
+// 当前的透明大页策略
+extern int thp_policy;
+
+/**
+ * @brief 为与 [addr, addr + len) 相交的 VMA 设置或清除 VM_HUGEPAGE，之后建立的映射按新标志决定是否用大页
+ * @param advice MADV_HUGEPAGE / MADV_NOHUGEPAGE
+ * @return int 不支持的 advice 返回 -1
+ */
+int mm_madvise(mm_struct_t* mm, uint64_t addr, uint64_t len, int advice);
+
+/**
+ * @brief 建立映射：没有 MAP_FIXED 时先试 addr，放不下就在 MMAP_BASE 之下自顶向下找空闲区间，
+ *        MAP_FIXED 则先解除 [addr, addr + len) 上原有的映射。页在第一次访问时才分配或映射
+ * @param prot PROT_* 的组合
+ * @param flags MAP_SHARED / MAP_PRIVATE 之一，可加 MAP_FIXED；匿名映射必须带 MAP_ANONYMOUS
+ * @param file 映射的文件，匿名映射为 NULL。文件页直接映射：MAP_SHARED 共用，MAP_PRIVATE 写时复制
+ * @param pgoff 映射起点在文件中的页号
+ * @return uint64_t 映射的起始地址，失败返回 MAP_FAILED
+ */
+uint64_t mm_mmap(mm_struct_t* mm, uint64_t addr, uint64_t len, int prot, int flags,
+                 struct ramfs_node* file, uint64_t pgoff);
+
+/**
+ * @brief 解除 [addr, addr + len) 上的映射：拆分跨边界的 VMA，释放物理页和变空的页表，整个调用只刷新一次 TLB
+ * @return int addr 未页对齐或范围越界返回 -1
+ */
+int mm_munmap(mm_struct_t* mm, uint64_t addr, uint64_t len);
+
+/**
+ * @brief 修改 [addr, addr + len) 的访问权限，范围必须全部已映射。已经映射的页就地改表项，
+ *        写时复制中仍被共享的页保持只读
+ * @param prot PROT_* 的组合
+ * @return int 范围中有空洞或参数非法返回 -1
+ */
+int mm_mprotect(mm_struct_t* mm, uint64_t addr, uint64_t len, int prot);
+
+/**
+ * @brief SYS_BRK：把堆顶移到 brk。堆是从 start_heap 开始的单个 VMA，扩展只延长 VMA，
+ *        页在第一次访问时分配；收缩解除并释放多出来的页
+ * @param brk 新的堆顶，0 或非法值只查询
+ * @return uint64_t 新的堆顶，失败时为原来的堆顶
+ */
+uint64_t mm_brk(mm_struct_t* mm, uint64_t brk);
+
+/**
+ * @brief [start, end) 中已经映射了物理页的页数
+ */
+size_t mm_resident_pages(mm_struct_t* mm, uint64_t start, uint64_t end);
+
+/**
+ * @brief 打印 VMA 查找次数与 mmap_cache 命中率
+ */
+void vma_dump_stats();
+
+/**
+ * @brief 打印透明大页策略，以及用户页中大页、小页的映射数
+ */
+void thp_dump_stats();
+
+/**
+ * @brief 打印 fork 耗时，以及写时复制共享、复制、直接复用的页数
+ */
+void cow_dump_stats();
+
+/**
+ * @brief SYS_THP 的处理函数
+ * @param cmd THP_DUMP 打印当前进程的缺页次数与堆的驻留情况、透明大页和写时复制统计，THP_ALWAYS / THP_MADVISE / THP_NEVER 切换策略
+ * @return int64_t 未知命令返回 -1
+ */
+int64_t thp_ctl(int cmd);
+
+/**
+ * @brief 复制地址空间：src -> dst。已映射的页不复制，父子共享；私有可写的页双方都改为只读，
+ *        写入时在缺页中复制（写时复制）
  * @param dst 目标地址空间
  * @param src 源地址空间
- * @return true 复制成功，false 复制失败
+ * @return true 复制成功，false 复制失败，已复制的部分留在 dst 中由调用者释放
  */
 bool mm_copy(mm_struct_t* dst, mm_struct_t* src);
 
+/**
+ * @brief 内存规整：把所有进程中映射到物理页号 [start_pgidx, end_pgidx) 的可迁移用户页
+ *        复制到新页并改写页表项，旧页标记 PG_isolated 留给调用者
+ * @param start_pgidx 起始页号
+ * @param end_pgidx 结束页号（不含）
+ * @return size_t 迁移的页数
+ */
+size_t mm_migrate_range(size_t start_pgidx, size_t end_pgidx);
@@ -2,6 +2,7 @@
 #include "../arch/x86_64.h"
 #include "../arch/switch.h"
 #include "sche.h"
+#include "../mm/slab.h"
 
 list_node_t proc_list;
 pcb_t *current_proc = NULL;
@@ -9,6 +10,9 @@ pcb_t *idle_proc = NULL;
 list_node_t ready_queue;
 int next_pid = 0;
 
+// PCB 对象缓存，按缓存行对齐
+static kmem_cache_t *pcb_cache = NULL;
+
 extern void kernel_thread_entry();
 
 int get_next_pid() { return next_pid++; }
@@ -19,7 +23,9 @@ void set_proc_name(pcb_t *proc, const char *name) {
 }
 
 pcb_t *alloc_new_pcb() {
-  pcb_t *new_pcb = (pcb_t *)kmalloc(sizeof(pcb_t));
+  pcb_t *new_pcb = (pcb_t *)kmem_cache_alloc(pcb_cache);
+  if (new_pcb == NULL)
+    return NULL;
   memset(new_pcb, 0, sizeof(pcb_t));
   new_pcb->pid = get_next_pid();
   new_pcb->time_slice = TIME_SLICE_DEFAULT;
@@ -40,6 +46,7 @@ void proc_init() {
   kprintln(" === Initializing process management === ");
   list_init(&proc_list);
   list_init(&ready_queue);
+  pcb_cache = kmem_cache_create("pcb_t", sizeof(pcb_t), CACHE_LINE_SIZE, NULL);
 
   pcb_t *idle = alloc_new_pcb();
   kprintf("Idle PCB address: %lx\n", (uint64_t)idle);
@@ -72,7 +79,7 @@ pcb_t *kthread_create(pcb_t *parent, const char *name,
   // 分配内核栈
   void *kstack_top = kstack_init(KSTACK_SIZE);
   if (kstack_top == NULL) {
-    kfree(proc);
+    kmem_cache_free(pcb_cache, proc);
     return NULL;
   }
   proc->rsp = (uint64_t)kstack_top;
@@ -143,7 +150,7 @@ void free_proc(pcb_t * proc)
     mm_free(proc->mm); // 假设有 mmfree 函数
   }
   // 释放 PCB 结构体
-  kfree(proc);
+  kmem_cache_free(pcb_cache, proc);
 
 }
 
@@ -198,13 +205,26 @@ uint64_t load_elf(pcb_t *proc,const char *elf_data)
   // 保存当前 CR3
   uint64_t old_cr3 = rcr3();
   // 切换到目标进程的页表
-  lcr3(proc->mm->pml4_pa);
+  switch_mm(proc->mm);
 
-  // 遍历 Program Headers
+  // 遍历 Program Headers，同时记下代码段和数据段的边界
+  mm_struct_t* mm = proc->mm;
+  mm->start_code = mm->start_data = UINT64_MAX;
+  mm->end_code = mm->end_data = 0;
   Elf64_Phdr* phdr = (Elf64_Phdr*)(elf_data + ehdr->e_phoff);
   for(int i=0;i<ehdr->e_phnum;i++)
   {
     if(phdr[i].p_type == PT_LOAD) {
+      uint64_t seg_start = phdr[i].p_vaddr;
+      uint64_t seg_end = phdr[i].p_vaddr + phdr[i].p_memsz;
+      if(phdr[i].p_flags & PF_X) {
+        if(seg_start < mm->start_code) mm->start_code = seg_start;
+        if(seg_end > mm->end_code) mm->end_code = seg_end;
+      } else {
+        if(seg_start < mm->start_data) mm->start_data = seg_start;
+        if(seg_end > mm->end_data) mm->end_data = seg_end;
+      }
+
       // 权限确定 
       uint64_t vm_flags = VM_READ;
       
@@ -222,15 +242,53 @@ uint64_t load_elf(pcb_t *proc,const char *elf_data)
       }
 
       // 拷贝数据段内容
-      memset((void*)phdr[i].p_vaddr,0,phdr[i].p_memsz); // 先清零
-      memcpy((void*)phdr[i].p_vaddr,(void*)(elf_data + phdr[i].p_offset),phdr[i].p_filesz);
+      // current_proc 不一定是 proc，缺页处理找不到这个地址空间，有文件内容的页先分配好；
+      // 其余的 bss 页第一次访问时才分配，本来就是零页
+      if(phdr[i].p_filesz) {
+        if(!mm_populate(proc->mm,phdr[i].p_vaddr,phdr[i].p_filesz)) {
+          kprintf("Error: Failed to populate segment at %lx\n", phdr[i].p_vaddr);
+          lcr3(old_cr3);
+          return 0;
+        }
+        memcpy((void*)phdr[i].p_vaddr,(void*)(elf_data + phdr[i].p_offset),phdr[i].p_filesz);
+      }
+      // bss 中已经有物理页的部分要清零：文件内容的最后一页、与其他段共享的页，
+      // 以及地址空间不是新建的时候残留的旧页。写共享页会先触发写时复制，不会改到别的进程
+      uint64_t file_end = phdr[i].p_vaddr + phdr[i].p_filesz;
+      uint64_t va = file_end;
+      while(va < seg_end) {
+        uint64_t size;
+        pte_t* leaf = vmm_get_leaf(mm->pml4, va, &size);
+        if(leaf == NULL) {
+          // 整张页表都不存在，跳到下一个 2MiB
+          va = ALIGN_DOWN(va, PAGE_SIZE_2M) + PAGE_SIZE_2M;
+          continue;
+        }
+        uint64_t next = ALIGN_DOWN(va, PAGE_SIZE) + PAGE_SIZE;
+        if(next > seg_end) next = seg_end;
+        if(*leaf & PTE_PRESENT) memset((void*)va, 0, next - va);
+        va = next;
+      }
     }
   }
   // 恢复原 CR3
   lcr3(old_cr3);
+  if(mm->start_code == UINT64_MAX) mm->start_code = 0;
+  if(mm->start_data == UINT64_MAX) mm->start_data = mm->end_data = mm->end_code;
+  // 堆从最后一个段之后的页开始，第一次 brk 扩展时才建立 VMA
+  mm->start_heap = mm->heap = ALIGN_UP(mm->end_data > mm->end_code ? mm->end_data : mm->end_code, PAGE_SIZE);
   return ehdr->e_entry; // 返回入口点
 }
 
+bool exec_mm_reset(pcb_t *proc)
+{
+  mm_struct_t *mm = proc->mm;
+  // 旧映像的 VMA 留着会挡住新映像的堆（brk 从 start_heap 向上扩展时撞上），段里也会残留旧数据
+  if(mm_munmap(mm, 0, USER_SPACE_END) < 0) return false;
+  uint64_t user_stack_base = USER_STACK_TOP - USER_STACK_SIZE;
+  return mm_map_range(mm, user_stack_base, USER_STACK_SIZE, VM_READ | VM_WRITE | VM_STACK);
+}
+
 pcb_t* create_user_process(const char *name, void *elf_data,uint64_t size)
 {
   kprintf("Start creating user process %s \n",name);
@@ -244,7 +302,7 @@ pcb_t* create_user_process(const char *name, void *elf_data,uint64_t size)
   // 创建内存空间
   proc->mm = mm_alloc();
   if(proc->mm == NULL) {
-    kfree(proc);
+    kmem_cache_free(pcb_cache, proc);
     return NULL;
   }
 
@@ -265,7 +323,7 @@ pcb_t* create_user_process(const char *name, void *elf_data,uint64_t size)
   // 设置用户栈
  
   uint64_t old_cr3 = rcr3();
-  lcr3(proc->mm->pml4_pa);
+  switch_mm(proc->mm);
 
   // 映射用户栈
   uint64_t user_stack_base = USER_STACK_TOP - USER_STACK_SIZE;
@@ -275,7 +333,6 @@ pcb_t* create_user_process(const char *name, void *elf_data,uint64_t size)
     free_proc(proc);
     return NULL;
   }
-  memset((void*)user_stack_base,0,USER_STACK_SIZE); // 清零栈空间
 
   lcr3(old_cr3);
 
@@ -317,10 +374,10 @@ int sys_fork()
 {
   pcb_t* parent = current_proc;
   pcb_t* child = alloc_new_pcb();
-  child->cwd_inode = parent->cwd_inode;
   if(child == NULL) {
     return -1; // 分配失败
   }
+  child->cwd_inode = parent->cwd_inode;
 
   set_proc_name(child, parent->name);
   child->parent = parent;
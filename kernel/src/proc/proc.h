@@ -5,7 +5,6 @@
 #include "../lib/elf.h"
 
 #define PROCNAME_LEN 32
-#define KSTACK_SIZE 0x4000    // 16KB
 #define MAX_FD 16
 
 
@@ -42,6 +41,7 @@ typedef struct pcb_t {
   void* fd_table[MAX_FD]; // 指向打开的 file 结构体
   int cwd_inode;
   int exit_code; // 退出码
+  uint64_t min_flt; // 次要缺页次数（按需分配物理页，不涉及磁盘）
 
 } pcb_t;
 
@@ -78,6 +78,15 @@ void free_proc(pcb_t *proc);
 
 uint64_t load_elf(pcb_t *proc, const char *elf_data);
 
+/**
+ * @brief execve 丢弃旧映像：解除全部用户映射（写时复制共享的页只减引用），重新建立用户栈 VMA
+ * 
+ * @param proc 
+ * @return true 
+ * @return false 内存不足
+ */
+bool exec_mm_reset(pcb_t *proc);
+
 // 定义用户栈的位置和大小
 #define USER_STACK_TOP  0x80000000  // 2GB 处
 #define USER_STACK_SIZE (4 * PAGE_SIZE) // 16KB
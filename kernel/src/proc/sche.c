@@ -57,7 +57,7 @@ void schedule() {
 
         // 切换页表 (如果需要，通常用于用户进程)
         if(next->mm != NULL && (prev->mm == NULL || prev->mm != next->mm)) {
-            lcr3(next->mm->pml4_pa);
+            switch_mm(next->mm);
         }
 
         // 汇编级上下文切换
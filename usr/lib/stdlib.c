@@ -7,8 +7,12 @@ typedef struct header {
     size_t size;        // 数据区大小
     struct header *next;// 下一块
     int free;           // 1=空闲
+    int mmapped;        // 1=单独 mmap 的大块，不在链表中
 } header_t;
 
+// 不小于该大小的请求单独 mmap，free 时 munmap，内存立即还给内核
+#define MMAP_THRESHOLD (128 * 1024)
+
 static header_t *head = NULL;
 static header_t *tail = NULL;
 
@@ -16,6 +20,18 @@ static header_t *tail = NULL;
 void *malloc(size_t size) {
     if (size == 0) return NULL;
 
+    // 0. 大块单独映射，不占用堆，也不会在链表中被小请求拆用
+    if (size >= MMAP_THRESHOLD) {
+        header_t *header = (header_t*)mmap(NULL, sizeof(header_t) + size, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (header == MAP_FAILED) return NULL;
+        header->size = size;
+        header->free = 0;
+        header->next = NULL;
+        header->mmapped = 1;
+        return (void*)(header + 1);
+    }
+
     // 1. 在现有链表中找空闲块
     header_t *curr = head;
     while (curr) {
@@ -38,6 +54,7 @@ void *malloc(size_t size) {
     header->size = size;
     header->free = 0;
     header->next = NULL;
+    header->mmapped = 0;
 
     // 3. 加入链表
     if (!head) head = header;
@@ -53,6 +70,10 @@ void free(void *ptr) {
 
     // 回退指针找到头部
     header_t *header = (header_t*)ptr - 1;
+    if (header->mmapped) {
+        munmap(header, sizeof(header_t) + header->size);
+        return;
+    }
     header->free = 1;
 
 }
@@ -14,9 +14,10 @@
  * - RDX: 第3个参数
  * - R10: 第4个参数 (预留，保持 ABI 通用性)
  * - R8 : 第5个参数
+ * - R9 : 第6个参数
  * * 触发方式：int $0x80 (中断号 128)
  */
-static inline int64_t syscall(uint64_t n, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5) {
+static inline int64_t syscall(uint64_t n, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5, uint64_t a6) {
     int64_t ret;
     
     // 将参数放入指定寄存器
@@ -24,6 +25,7 @@ static inline int64_t syscall(uint64_t n, uint64_t a1, uint64_t a2, uint64_t a3,
     // 但为了代码的健壮性和 ABI 一致性，我们依然使用 r10 传递第4个参数。
     register uint64_t r10 __asm__("r10") = a4;
     register uint64_t r8  __asm__("r8")  = a5;
+    register uint64_t r9  __asm__("r9")  = a6;
 
     __asm__ volatile (
         "int $0x80"             // <--- 关键修改：使用中断触发，而不是 syscall 指令
@@ -33,18 +35,21 @@ static inline int64_t syscall(uint64_t n, uint64_t a1, uint64_t a2, uint64_t a3,
           "S"(a2),              // RSI (参数2)
           "d"(a3),              // RDX (参数3)
           "r"(r10),             // R10 (参数4)
-          "r"(r8)               // R8  (参数5)
+          "r"(r8),              // R8  (参数5)
+          "r"(r9)               // R9  (参数6)
         : "memory"              // 内存屏障，防止编译器乱序
     );
     return ret;
 }
 
 // 辅助宏：简化调用参数
-#define SYSCALL0(n)             syscall(n, 0, 0, 0, 0, 0)
-#define SYSCALL1(n, a1)         syscall(n, (uint64_t)a1, 0, 0, 0, 0)
-#define SYSCALL2(n, a1, a2)     syscall(n, (uint64_t)a1, (uint64_t)a2, 0, 0, 0)
-#define SYSCALL3(n, a1, a2, a3) syscall(n, (uint64_t)a1, (uint64_t)a2, (uint64_t)a3, 0, 0)
-#define SYSCALL4(n, a1, a2, a3, a4) syscall(n, (uint64_t)a1, (uint64_t)a2, (uint64_t)a3, (uint64_t)a4, 0)
+#define SYSCALL0(n)             syscall(n, 0, 0, 0, 0, 0, 0)
+#define SYSCALL1(n, a1)         syscall(n, (uint64_t)a1, 0, 0, 0, 0, 0)
+#define SYSCALL2(n, a1, a2)     syscall(n, (uint64_t)a1, (uint64_t)a2, 0, 0, 0, 0)
+#define SYSCALL3(n, a1, a2, a3) syscall(n, (uint64_t)a1, (uint64_t)a2, (uint64_t)a3, 0, 0, 0)
+#define SYSCALL4(n, a1, a2, a3, a4) syscall(n, (uint64_t)a1, (uint64_t)a2, (uint64_t)a3, (uint64_t)a4, 0, 0)
+#define SYSCALL6(n, a1, a2, a3, a4, a5, a6) \
+    syscall(n, (uint64_t)a1, (uint64_t)a2, (uint64_t)a3, (uint64_t)a4, (uint64_t)a5, (uint64_t)a6)
 
 // ============================================================================
 // 2. 基础 IO 函数封装
@@ -156,6 +161,22 @@ void *sbrk(intptr_t increment) {
     return current_brk;
 }
 
+int madvise(void *addr, unsigned long len, int advice) {
+    return (int)SYSCALL3(SYS_MADVISE, addr, len, advice);
+}
+
+void *mmap(void *addr, unsigned long len, int prot, int flags, int fd, long offset) {
+    return (void *)SYSCALL6(SYS_MMAP, addr, len, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, unsigned long len) {
+    return (int)SYSCALL2(SYS_MUNMAP, addr, len);
+}
+
+int mprotect(void *addr, unsigned long len, int prot) {
+    return (int)SYSCALL3(SYS_MPROTECT, addr, len, prot);
+}
+
 // ============================================================================
 // 6. 时间函数
 // ============================================================================
@@ -169,4 +190,16 @@ unsigned int sleep(unsigned int seconds) {
     long rem[2] = { 0, 0 };
     nanosleep(req, rem);
     return rem[0]; // 返回剩余时间
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// 7. 调试
+// ============================================================================
+
+int kmprof(int cmd) {
+    return (int)SYSCALL1(SYS_KMPROF, cmd);
+}
+
+int thp(int cmd) {
+    return (int)SYSCALL1(SYS_THP, cmd);
+}
@@ -65,20 +65,44 @@
 // 参数: rdi=brk_addr (目标地址)
 // 实现: 
 //   1. 如果 addr == 0，返回当前堆顶 (current_brk)。
-//   2. 如果 addr > current_brk，分配物理页并映射到页表，更新 current_brk。
+//   2. 如果 addr > current_brk，延长堆 VMA（页在第一次访问时才分配），更新 current_brk；
+//      addr < current_brk 时解除并释放多出来的页。
 //   3. 这是 C 库 malloc 的底层支撑。
 #define SYS_BRK     12
 
 // 功能: 内存映射 (加载动态库或大文件)
 // 参数: rdi=addr, rsi=len, rdx=prot, r10=flags, r8=fd, r9=offset
-// 实现: 初期可只实现 "匿名映射" (flags=MAP_ANONYMOUS)，相当于申请一大块内存
+// 实现: 匿名映射 (flags 带 MAP_ANONYMOUS) 或 ramfs 文件映射，在栈下方自顶向下找空闲区间，
+//       页在第一次访问时分配或映射。文件页不复制：MAP_SHARED 共用，MAP_PRIVATE 写时复制；
+//       offset 须页对齐。失败返回 MAP_FAILED
 #define SYS_MMAP    9
+#define PROT_NONE  0x0
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+#define MAP_SHARED    0x01
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
+#define MAP_FAILED ((void *)-1)
+
+// 功能: 修改一段已映射内存的访问权限
+// 参数: rdi=addr, rsi=len, rdx=prot
+// 实现: 拆分/合并 VMA，就地改写已映射页的页表项
+#define SYS_MPROTECT 10
 
 // 功能: 解除内存映射
 // 参数: rdi=addr, rsi=len
-// 实现: 释放对应的页表映射和物理页
+// 实现: 释放对应的页表映射、物理页和变空的页表
 #define SYS_MUNMAP  11
 
+// 功能: 给出内存使用建议
+// 参数: rdi=addr, rsi=len, rdx=advice
+// 实现: 目前只支持 MADV_HUGEPAGE / MADV_NOHUGEPAGE，标记区域是否使用 2MiB 透明大页
+#define SYS_MADVISE 28
+#define MADV_HUGEPAGE   14
+#define MADV_NOHUGEPAGE 15
+
 // --- 进程管理 (核心 - 支撑 Shell 运行程序) ---
 // 功能: 主动让出 CPU
 // 参数: 无
@@ -133,6 +157,25 @@
 // 实现: 读取 RTC 或系统启动后的 tick 数并转换
 #define SYS_GETTIMEOFDAY 96
 
+// --- SudoOS 调试 ---
+// 功能: 控制按调用点统计的 kmalloc 剖析器
+// 参数: rdi=cmd (0=打印统计, 1=开启, 2=关闭, 3=清空)
+// 实现: kmprof_ctl()，统计结果打印在内核控制台
+#define SYS_KMPROF 500
+#define KMPROF_DUMP  0
+#define KMPROF_ON    1
+#define KMPROF_OFF   2
+#define KMPROF_RESET 3
+
+// 功能: 查看透明大页与写时复制统计，或切换透明大页策略
+// 参数: rdi=cmd (0=打印统计, 1=always, 2=madvise, 3=never)
+// 实现: thp_ctl()，统计结果打印在内核控制台
+#define SYS_THP 501
+#define THP_DUMP    0
+#define THP_ALWAYS  1
+#define THP_MADVISE 2
+#define THP_NEVER   3
+
 
 struct linux_dirent64 {
     uint64_t d_ino;
@@ -171,9 +214,17 @@ void sched_yield(void);
 // 内存
 void *brk(void *addr);
 void *sbrk(intptr_t increment);
+int madvise(void *addr, unsigned long len, int advice);
+void *mmap(void *addr, unsigned long len, int prot, int flags, int fd, long offset);
+int munmap(void *addr, unsigned long len);
+int mprotect(void *addr, unsigned long len, int prot);
 
 // 时间
 int nanosleep(const void *req, void *rem);
 unsigned int sleep(unsigned int seconds);
 
+// 调试
+int kmprof(int cmd);
+int thp(int cmd);
+
 #endif
\ No newline at end of file
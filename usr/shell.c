@@ -76,17 +76,20 @@ void cmd_help() {
     printf("\nSystem:\n");
     printf("  clear           Clear the screen\n");
     printf("  run <id>        Interactive Syscall Runner\n");
+    printf("  kmprof [on|off|reset]  Kernel kmalloc profile by call site\n");
+    printf("  thp [always|madvise|never]  THP/COW stats, or set THP policy\n");
     printf("  exit            Exit the shell\n");
 
     printf("\n[Debug] Syscall Table (ID : Name):\n");
-    printf("   0 : READ          1 : WRITE         2 : OPEN\n");
-    printf("   3 : CLOSE         4 : STAT          5 : FSTAT\n");
-    printf("   8 : LSEEK         9 : MMAP         11 : MUNMAP\n");
-    printf("  12 : BRK          24 : YIELD        35 : NANOSLEEP\n");
-    printf("  39 : GETPID       57 : FORK         59 : EXECVE\n");
-    printf("  60 : EXIT         61 : WAIT4        79 : GETCWD\n");
-    printf("  80 : CHDIR        83 : MKDIR        96 : GETTIMEOFDAY\n");
-    printf(" 110 : GETPPID     217 : GETDENTS64\n");
+    printf("   0 : READ           1 : WRITE          2 : OPEN\n");
+    printf("   3 : CLOSE          4 : STAT           5 : FSTAT\n");
+    printf("   8 : LSEEK          9 : MMAP          10 : MPROTECT\n");
+    printf("  11 : MUNMAP        12 : BRK           24 : YIELD\n");
+    printf("  28 : MADVISE       35 : NANOSLEEP     39 : GETPID\n");
+    printf("  57 : FORK          59 : EXECVE        60 : EXIT\n");
+    printf("  61 : WAIT4         79 : GETCWD        80 : CHDIR\n");
+    printf("  83 : MKDIR         96 : GETTIMEOFDAY 110 : GETPPID\n");
+    printf(" 217 : GETDENTS64   500 : KMPROF       501 : THP\n");
 }
 
 void cmd_ls(char* path) {
@@ -222,6 +225,32 @@ void cmd_run(char* arg_id) {
     }
 }
 
+void cmd_kmprof(char* arg) {
+    int cmd = KMPROF_DUMP;
+    if (arg == NULL) cmd = KMPROF_DUMP;
+    else if (strcmp(arg, "on") == 0) cmd = KMPROF_ON;
+    else if (strcmp(arg, "off") == 0) cmd = KMPROF_OFF;
+    else if (strcmp(arg, "reset") == 0) cmd = KMPROF_RESET;
+    else {
+        printf("Usage: kmprof [on|off|reset]\n");
+        return;
+    }
+    if (kmprof(cmd) < 0) printf("kmprof failed.\n");
+}
+
+void cmd_thp(char* arg) {
+    int cmd = THP_DUMP;
+    if (arg == NULL) cmd = THP_DUMP;
+    else if (strcmp(arg, "always") == 0) cmd = THP_ALWAYS;
+    else if (strcmp(arg, "madvise") == 0) cmd = THP_MADVISE;
+    else if (strcmp(arg, "never") == 0) cmd = THP_NEVER;
+    else {
+        printf("Usage: thp [always|madvise|never]\n");
+        return;
+    }
+    if (thp(cmd) < 0) printf("thp failed.\n");
+}
+
 // === 主程序入口 ===
 
 void shell_main() {
@@ -300,6 +329,8 @@ void shell_main() {
         }
         else if (strcmp(args[0], "exit") == 0) exit(0);
         else if (strcmp(args[0], "run") == 0) cmd_run(args[1]);
+        else if (strcmp(args[0], "kmprof") == 0) cmd_kmprof(argc > 1 ? args[1] : NULL);
+        else if (strcmp(args[0], "thp") == 0) cmd_thp(argc > 1 ? args[1] : NULL);
         else printf("Unknown command: %s\n", args[0]);
     }
 }
\ No newline at end of file